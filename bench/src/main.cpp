@@ -0,0 +1,428 @@
+#include "bf/frontend.h"
+#include "bf/lexer.h"
+#include "bf/optimizer.h"
+#include "bf/parser.h"
+#include "engine.h"
+#include "jit.h"
+#include "threaded.h"
+#include "transpile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// 比较时低于这个耗时（毫秒）的阶段只看计数和 RSS，不看耗时：噪声远大于阈值
+constexpr double MIN_COMPARABLE_MS = 0.5;
+
+// 一个被测阶段：setup 在计时之外准备输入，run 返回该阶段的计数
+//   lex       -> token 数
+//   parse     -> IR 指令数（未优化）
+//   frontend  -> IR 指令数（mmap 单遍前端，未优化）
+//   optimize  -> IR 指令数（优化后）
+//   interpret -> 执行的 IR 指令数
+//   transpile -> 生成的 C 代码字节数
+struct Stage {
+    std::string name;
+    std::function<void()> setup;
+    std::function<uint64_t()> run;
+};
+
+struct Sample {
+    double wall_ms = 0;
+    long rss_delta_kb = 0; // 阶段运行期间峰值 RSS 比运行前高出的部分
+    uint64_t count = 0;
+};
+
+struct Result {
+    std::string program;
+    std::string stage;
+    Sample median;
+};
+
+// 本进程至今的峰值 RSS（KB）
+static long self_peak_rss_kb() {
+    struct rusage ru{};
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+}
+
+// 在 fork 出的子进程中运行阶段：标准输入来自 input_fd，标准输出丢弃。
+// 耗时和 RSS 都只包住 run()：子进程继承了父进程的页，setup 也会分配，
+// 所以以 run() 之前的峰值为基线，报告运行后峰值高出基线的部分
+static Sample run_isolated(const Stage& stage, int input_fd) {
+    int fds[2];
+    if (pipe(fds) != 0) throw std::runtime_error("pipe failed");
+
+    pid_t pid = fork();
+    if (pid < 0) throw std::runtime_error("fork failed");
+    if (pid == 0) {
+        close(fds[0]);
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        dup2(input_fd, STDIN_FILENO);
+        lseek(STDIN_FILENO, 0, SEEK_SET);
+
+        if (stage.setup) stage.setup();
+        const long base_kb = self_peak_rss_kb();
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t count = stage.run();
+        auto t1 = std::chrono::steady_clock::now();
+        std::fflush(stdout);
+
+        Sample s;
+        s.wall_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        s.rss_delta_kb = self_peak_rss_kb() - base_kb;
+        s.count = count;
+        ssize_t n = write(fds[1], &s, sizeof(s));
+        _exit(n == static_cast<ssize_t>(sizeof(s)) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    Sample s;
+    ssize_t n = read(fds[0], &s, sizeof(s));
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (n != static_cast<ssize_t>(sizeof(s)) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        throw std::runtime_error("stage '" + stage.name + "' failed");
+    }
+    return s;
+}
+
+template <typename T>
+static T median_of(std::vector<T> v) {
+    std::sort(v.begin(), v.end());
+    size_t n = v.size();
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static std::string read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) throw std::runtime_error("cannot open file '" + path + "'");
+    std::ostringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+static std::string program_name(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    size_t dot = name.rfind('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+// ---------------------------------------------------------------------------
+// JSON 基线：每个结果一个对象，只由本工具读写，读取时按字段名查找即可
+
+static std::string json_escape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+static void save_json(const std::string& path, const std::vector<Result>& results,
+                      int runs, const std::string& engine) {
+    std::ofstream out(path);
+    if (!out) throw std::runtime_error("cannot write '" + path + "'");
+    out << "{\n";
+    out << "  \"runs\": " << runs << ",\n";
+    out << "  \"engine\": \"" << engine << "\",\n";
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        out << "    {\"program\": \"" << json_escape(r.program) << "\", "
+            << "\"stage\": \"" << r.stage << "\", "
+            << "\"wall_ms\": " << std::fixed << std::setprecision(4) << r.median.wall_ms << ", "
+            << "\"rss_delta_kb\": " << r.median.rss_delta_kb << ", "
+            << "\"count\": " << r.median.count << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+static std::string json_string(const std::string& obj, const std::string& key) {
+    size_t k = obj.find("\"" + key + "\"");
+    if (k == std::string::npos) return "";
+    size_t q = obj.find('"', obj.find(':', k) + 1);
+    std::string value;
+    for (size_t i = q + 1; i < obj.size() && obj[i] != '"'; ++i) {
+        if (obj[i] == '\\' && i + 1 < obj.size()) ++i;
+        value += obj[i];
+    }
+    return value;
+}
+
+static double json_number(const std::string& obj, const std::string& key) {
+    size_t k = obj.find("\"" + key + "\"");
+    if (k == std::string::npos) return 0;
+    return std::strtod(obj.c_str() + obj.find(':', k) + 1, nullptr);
+}
+
+static std::vector<Result> load_json(const std::string& path) {
+    std::string text = read_file(path);
+    std::vector<Result> results;
+    size_t pos = text.find("\"results\"");
+    while (pos != std::string::npos) {
+        size_t open = text.find('{', pos);
+        if (open == std::string::npos) break;
+        size_t close = text.find('}', open);
+        if (close == std::string::npos) break;
+        std::string obj = text.substr(open, close - open + 1);
+        Result r;
+        r.program = json_string(obj, "program");
+        r.stage = json_string(obj, "stage");
+        r.median.wall_ms = json_number(obj, "wall_ms");
+        r.median.rss_delta_kb = static_cast<long>(json_number(obj, "rss_delta_kb"));
+        r.median.count = static_cast<uint64_t>(json_number(obj, "count"));
+        results.push_back(r);
+        pos = close + 1;
+    }
+    return results;
+}
+
+// 与基线逐项比较，返回超过阈值的退化项数
+static int compare(const std::vector<Result>& baseline, const std::vector<Result>& current,
+                   double threshold_pct) {
+    auto pct = [](double base, double now) { return (now - base) / base * 100.0; };
+    int regressions = 0;
+    std::cout << std::defaultfloat << "\nCompared with baseline (threshold " << threshold_pct << "%):\n";
+    for (const auto& cur : current) {
+        auto it = std::find_if(baseline.begin(), baseline.end(), [&](const Result& b) {
+            return b.program == cur.program && b.stage == cur.stage;
+        });
+        if (it == baseline.end()) {
+            std::cout << "  " << cur.program << "/" << cur.stage << ": not in baseline\n";
+            continue;
+        }
+        const Sample& b = it->median;
+        const Sample& c = cur.median;
+        std::vector<std::string> flags;
+        std::ostringstream line;
+        line << std::fixed << std::setprecision(1);
+        if (b.wall_ms >= MIN_COMPARABLE_MS && c.wall_ms > b.wall_ms) {
+            double d = pct(b.wall_ms, c.wall_ms);
+            if (d > threshold_pct) {
+                line.str("");
+                line << "wall " << b.wall_ms << " -> " << c.wall_ms << " ms (+" << d << "%)";
+                flags.push_back(line.str());
+            }
+        }
+        if (b.rss_delta_kb > 0 && c.rss_delta_kb > b.rss_delta_kb) {
+            double d = pct(static_cast<double>(b.rss_delta_kb), static_cast<double>(c.rss_delta_kb));
+            if (d > threshold_pct) {
+                line.str("");
+                line << "RSS growth " << b.rss_delta_kb << " -> " << c.rss_delta_kb << " KB (+" << d << "%)";
+                flags.push_back(line.str());
+            }
+        }
+        if (b.count > 0 && c.count > b.count) {
+            double d = pct(static_cast<double>(b.count), static_cast<double>(c.count));
+            if (d > threshold_pct) {
+                line.str("");
+                line << "count " << b.count << " -> " << c.count << " (+" << d << "%)";
+                flags.push_back(line.str());
+            }
+        }
+        for (const auto& f : flags) {
+            std::cout << "  REGRESSION " << cur.program << "/" << cur.stage << ": " << f << "\n";
+            ++regressions;
+        }
+    }
+    if (regressions == 0) std::cout << "  no regressions\n";
+    return regressions;
+}
+
+// ---------------------------------------------------------------------------
+
+static void print_usage() {
+    std::cerr << "Usage:\n"
+              << "  bf-bench [programs.bf...] [options]\n"
+              << "  (default programs: bench, mandelbrot, numwarp, squares from tests/)\n"
+              << "Options:\n"
+              << "  --runs=N           Runs per stage, the median is reported (default 5)\n"
+              << "  --engine=E         Engine for the interpret stage: switch|threaded|tiered|jit (default switch)\n"
+              << "  --input=STR        Standard input for the interpret stage (default \"1234567890\\n\")\n"
+              << "  --save=FILE        Write results to a JSON baseline file\n"
+              << "  --compare=FILE     Compare with a JSON baseline, exit 1 on regressions\n"
+              << "  --threshold=PCT    Regression threshold in percent (default 10)\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> files;
+    int runs = 5;
+    std::string engine = "switch";
+    std::string input = "1234567890\n";
+    std::string save_path;
+    std::string compare_path;
+    double threshold = 10.0;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--runs=", 0) == 0) {
+            runs = std::atoi(arg.c_str() + 7);
+            if (runs < 1) { std::cerr << "Invalid run count: " << arg.substr(7) << "\n"; return 1; }
+        } else if (arg.rfind("--engine=", 0) == 0) {
+            engine = arg.substr(9);
+            if (engine != "switch" && engine != "threaded" && engine != "tiered" &&
+                engine != "jit") {
+                std::cerr << "Unknown engine: " << engine << "\n";
+                return 1;
+            }
+        } else if (arg.rfind("--input=", 0) == 0) {
+            input = arg.substr(8);
+        } else if (arg.rfind("--save=", 0) == 0) {
+            save_path = arg.substr(7);
+        } else if (arg.rfind("--compare=", 0) == 0) {
+            compare_path = arg.substr(10);
+        } else if (arg.rfind("--threshold=", 0) == 0) {
+            threshold = std::atof(arg.c_str() + 12);
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage();
+            return 0;
+        } else if (arg[0] != '-') {
+            files.push_back(arg);
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (files.empty()) {
+        for (const char* name : {"bench", "mandelbrot", "numwarp", "squares"}) {
+            files.push_back(std::string(BF_TESTS_DIR) + "/" + name + ".bf");
+        }
+    }
+    if (engine == "tiered" && !(bf::threaded_engine_available() && bf::jit_available())) {
+        std::cerr << "Warning: tiered engine unavailable, using threaded\n";
+        engine = "threaded";
+    }
+    if (engine == "threaded" && !bf::threaded_engine_available()) {
+        std::cerr << "Warning: threaded engine unavailable, using switch\n";
+        engine = "switch";
+    }
+    if (engine == "jit" && !bf::jit_available()) {
+        std::cerr << "Warning: JIT unavailable, using switch\n";
+        engine = "switch";
+    }
+
+    // 解释阶段的标准输入：写入临时文件，每次运行前回到开头
+    std::FILE* input_file = std::tmpfile();
+    if (!input_file) { std::cerr << "Error: cannot create input file\n"; return 1; }
+    std::fwrite(input.data(), 1, input.size(), input_file);
+    std::fflush(input_file);
+    int input_fd = fileno(input_file);
+
+    std::vector<Result> results;
+    bf::RunOptions run_opts;
+    if (engine == "tiered") run_opts.tier_threshold = 1000;
+
+    std::cout << std::left << std::setw(14) << "program" << std::setw(11) << "stage"
+              << std::right << std::setw(12) << "wall ms" << std::setw(14) << "RSS +KB"
+              << std::setw(16) << "count" << "\n";
+
+    try {
+        for (const auto& path : files) {
+            // 各阶段的输入在父进程中准备好，子进程通过 fork 继承
+            const std::string source = read_file(path);
+            const std::vector<char> tokens = bf::lex(source);
+            const std::vector<bf::IRInst> parsed = bf::parse(tokens);
+            const bf::PackedProgram raw = bf::pack(parsed);
+            bf::PackedProgram optimized = raw;
+            bf::optimize_in_place(optimized);
+            const std::vector<bf::IRInst> optimized_ir = bf::unpack(optimized);
+
+            bf::PackedProgram work;
+            std::vector<uint64_t> counts;
+            std::vector<Stage> stages = {
+                {"lex", nullptr, [&] { return static_cast<uint64_t>(bf::lex(source).size()); }},
+                {"parse", nullptr, [&] { return static_cast<uint64_t>(bf::parse(tokens).size()); }},
+                {"frontend", nullptr, [&] { return static_cast<uint64_t>(bf::parse_file(path).size()); }},
+                {"optimize", [&] { work = raw; }, [&] {
+                    bf::optimize_in_place(work);
+                    return static_cast<uint64_t>(work.size());
+                }},
+                {"interpret", nullptr, [&]() -> uint64_t {
+                    if (engine == "jit") bf::run_jit(optimized_ir, run_opts);
+                    else if (engine == "threaded" || engine == "tiered")
+                        bf::interpret_threaded(optimized_ir, run_opts);
+                    else bf::interpret(optimized, run_opts);
+                    return 0;
+                }},
+                {"transpile", nullptr, [&] {
+                    return static_cast<uint64_t>(bf::transpile_to_c(optimized_ir).size());
+                }},
+            };
+
+            // 执行的指令数与引擎无关，用计数版 switch 引擎单独跑一次（不计时）
+            Stage counting{"count", nullptr, [&] {
+                bf::interpret_counting(optimized, run_opts, counts);
+                return std::accumulate(counts.begin(), counts.end(), uint64_t{0});
+            }};
+            uint64_t executed = run_isolated(counting, input_fd).count;
+
+            std::string name = program_name(path);
+            for (const auto& stage : stages) {
+                std::vector<double> wall;
+                std::vector<long> rss;
+                Sample last;
+                for (int r = 0; r < runs; ++r) {
+                    last = run_isolated(stage, input_fd);
+                    wall.push_back(last.wall_ms);
+                    rss.push_back(last.rss_delta_kb);
+                }
+                Result res;
+                res.program = name;
+                res.stage = stage.name;
+                res.median.wall_ms = median_of(wall);
+                res.median.rss_delta_kb = median_of(rss);
+                res.median.count = stage.name == "interpret" ? executed : last.count;
+                results.push_back(res);
+
+                std::cout << std::left << std::setw(14) << name << std::setw(11) << stage.name
+                          << std::right << std::fixed << std::setprecision(3)
+                          << std::setw(12) << res.median.wall_ms
+                          << std::setw(14) << res.median.rss_delta_kb
+                          << std::setw(16) << res.median.count << "\n";
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    int regressions = 0;
+    try {
+        if (!compare_path.empty()) regressions = compare(load_json(compare_path), results, threshold);
+        if (!save_path.empty()) {
+            save_json(save_path, results, runs, engine);
+            std::cout << "\nSaved baseline to " << save_path << "\n";
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+#include "bf/batch.h"
+#include "bf/frontend.h"
+#include "bf/optimizer.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// 静态 n-gram 统计：对语料中每个程序优化后的 IR 按操作码序列计数，
+// 用来挑选解释器中值得融合成超级指令的模式（见 interpreter/src/superinst.h）
+
+static void print_usage() {
+    std::cerr << "Usage:\n"
+              << "  bf-ngrams [files, directories or @listfiles...] [options]\n"
+              << "  (default corpus: every .bf file in tests/)\n"
+              << "Options:\n"
+              << "  --min-n=N        Shortest sequence to count (default 2)\n"
+              << "  --max-n=N        Longest sequence to count (default 3)\n"
+              << "  --top=K          Sequences listed per length (default 15)\n"
+              << "  --cell-bits=N    Cell width passed to the optimizer (default 8)\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> paths;
+    int min_n = 2;
+    int max_n = 3;
+    size_t top = 15;
+    int cell_bits = 8;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--min-n=", 0) == 0) {
+            min_n = std::atoi(arg.c_str() + 8);
+        } else if (arg.rfind("--max-n=", 0) == 0) {
+            max_n = std::atoi(arg.c_str() + 8);
+        } else if (arg.rfind("--top=", 0) == 0) {
+            top = static_cast<size_t>(std::atol(arg.c_str() + 6));
+        } else if (arg.rfind("--cell-bits=", 0) == 0) {
+            cell_bits = std::atoi(arg.c_str() + 12);
+            if (!bf::valid_cell_bits(cell_bits)) {
+                std::cerr << "Invalid cell width: " << arg.substr(12) << "\n";
+                return 1;
+            }
+        } else if (arg == "-h" || arg == "--help") {
+            print_usage();
+            return 0;
+        } else if (arg[0] != '-') {
+            paths.push_back(arg);
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            print_usage();
+            return 1;
+        }
+    }
+    if (min_n < 1 || max_n < min_n) {
+        std::cerr << "Invalid n-gram length range: " << min_n << ".." << max_n << "\n";
+        return 1;
+    }
+    if (paths.empty()) paths.push_back(BF_TESTS_DIR);
+
+    // counts[n - min_n] 为长度 n 的序列 -> 出现次数
+    std::vector<std::map<std::vector<uint8_t>, uint64_t>> counts(max_n - min_n + 1);
+    std::vector<uint64_t> totals(counts.size(), 0);
+    uint64_t instructions = 0;
+    size_t programs = 0;
+
+    try {
+        for (const auto& path : bf::expand_inputs(paths)) {
+            bf::PackedProgram program = bf::parse_file(path);
+            bf::optimize_in_place(program, cell_bits);
+            const auto& ops = program.ops;
+            instructions += ops.size();
+            ++programs;
+            for (int n = min_n; n <= max_n; ++n) {
+                for (size_t i = 0; i + n <= ops.size(); ++i) {
+                    ++counts[n - min_n][std::vector<uint8_t>(ops.begin() + i, ops.begin() + i + n)];
+                    ++totals[n - min_n];
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+
+    std::cout << programs << " programs, " << instructions << " optimized IR instructions\n";
+    for (int n = min_n; n <= max_n; ++n) {
+        const auto& table = counts[n - min_n];
+        std::vector<std::pair<std::vector<uint8_t>, uint64_t>> sorted(table.begin(), table.end());
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const auto& a, const auto& b) { return a.second > b.second; });
+        uint64_t total = totals[n - min_n];
+
+        std::cout << "\n" << n << "-grams (" << total << " total, " << table.size() << " distinct):\n";
+        for (size_t r = 0; r < sorted.size() && r < top; ++r) {
+            std::string seq;
+            for (uint8_t op : sorted[r].first) {
+                if (!seq.empty()) seq += ";";
+                seq += bf::ir_type_name(static_cast<bf::IRType>(op));
+            }
+            double pct = total ? 100.0 * sorted[r].second / total : 0.0;
+            std::cout << std::setw(6) << r + 1 << std::setw(10) << sorted[r].second
+                      << std::fixed << std::setprecision(1) << std::setw(8) << pct << "%  "
+                      << seq << "\n";
+        }
+    }
+    return 0;
+}
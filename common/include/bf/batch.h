@@ -0,0 +1,31 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bf {
+
+// 展开命令行给出的批量输入：目录取其中的 .bf 文件（按名字排序，不递归），
+// "@list" 读取列表文件，每行一个路径（忽略空行和 # 开头的行，列表中的目录同样展开），
+// 其余参数原样作为文件路径。列表文件无法打开时抛出 std::runtime_error
+std::vector<std::string> expand_inputs(const std::vector<std::string>& args);
+
+// 批量处理中一个输入的错误
+struct BatchError {
+    std::string input;
+    std::string message;
+};
+
+// 找出输出路径相同的输入：output_of 给出每个输入的输出路径（规范化后比较），
+// 冲突组中的每个输入都记一条错误并从 inputs 中移除，避免多个线程同时写同一个文件。
+// 返回的错误按输入顺序排列
+std::vector<BatchError> take_output_conflicts(std::vector<std::string>& inputs,
+                                              const std::function<std::string(const std::string&)>& output_of);
+
+// 在 jobs 个线程（0 表示硬件线程数）的工作窃取线程池上对每个输入调用 job。
+// 输入先按连续的块分给各线程，自己的队列空了就从其他线程队列的尾部窃取。
+// job 抛出的异常记为该输入的错误，不影响其他输入；返回全部错误，按输入顺序排列
+std::vector<BatchError> run_batch(const std::vector<std::string>& inputs, unsigned jobs,
+                                  const std::function<void(const std::string&)>& job);
+
+} // namespace bf
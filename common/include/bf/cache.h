@@ -0,0 +1,45 @@
+#pragma once
+#include <string>
+#include <vector>
+
+namespace bf {
+
+// 按内容寻址的编译结果缓存。
+// 键是 lex 之后的 token 流与编译设置（工具、后端、格式、各选项）的 SHA-256，
+// 只改注释或空白的源文件 token 流不变，仍能命中。值是写好的 PE/ELF/汇编/C 文件，
+// 命中时复制到输出路径，不再经过前端和代码生成；不用硬链接，输出与条目互不影响。
+// 工具的代码生成结果改变时提高 CACHE_VERSION，使旧条目全部失效。
+class CompileCache {
+public:
+    static constexpr int CACHE_VERSION = 5;
+
+    // dir 为空时使用 default_dir()
+    explicit CompileCache(std::string dir = {});
+
+    // $XDG_CACHE_HOME/bfcompiler，未设置时为 $HOME/.cache/bfcompiler
+    // （Windows 上为 %LOCALAPPDATA%\bfcompiler）
+    static std::string default_dir();
+
+    const std::string& dir() const { return dir_; }
+
+    // config 描述影响输出的全部设置，由调用方按固定格式拼出
+    static std::string key(const std::vector<char>& tokens, const std::string& config);
+
+    // 命中时把缓存的文件复制到 output 并返回 true。output 是独立的副本，
+    // 之后对它的原地改写不会波及缓存条目
+    bool fetch(const std::string& key, const std::string& output) const;
+
+    // 把刚写好的 output 复制进缓存。先写临时文件再原子地改名，
+    // 可以在多个线程或进程中同时调用；写入失败时不报错，只是不缓存
+    void store(const std::string& key, const std::string& output) const;
+
+private:
+    std::string entry_path(const std::string& key) const;
+
+    std::string dir_;
+};
+
+// 读入整个文件，无法打开时抛出 std::runtime_error
+std::string read_file(const std::string& path);
+
+} // namespace bf
@@ -0,0 +1,19 @@
+#pragma once
+#include "packed_ir.h"
+#include <cstddef>
+#include <string>
+
+namespace bf {
+
+// 单遍前端：过滤字符、解析括号并合并连续的 MovePtr/AddVal 一次完成，
+// 直接写入 PackedProgram，不生成中间的 token 数组。结果与 parse(lex(source))
+// 再做连续指令合并相同，且 jump_target 已经正确。
+// track_locs 为 true 时记录每条指令的源码行列号（合并的指令取第一个字符的位置）。
+// 括号不匹配时抛出 std::runtime_error，消息中带有出错位置
+PackedProgram parse_source(const char* data, size_t size, bool track_locs = false);
+
+// 内存映射源文件后调用 parse_source，峰值内存只与 IR 大小成正比
+// 文件无法打开或映射时抛出 std::runtime_error
+PackedProgram parse_file(const std::string& path, bool track_locs = false);
+
+} // namespace bf
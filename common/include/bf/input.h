@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+namespace bf {
+
+// 读到 EOF 时 Input 对单元格的处理
+enum class EofMode {
+    Unchanged, // 保持原值
+    Zero,      // 写入 0
+    MinusOne,  // 写入 -1，即按单元格宽度全为 1
+};
+
+// 解析 --eof= 的取值 unchanged / 0 / -1，无法识别时返回 false
+inline bool parse_eof_mode(const std::string& s, EofMode& mode) {
+    if (s == "unchanged") mode = EofMode::Unchanged;
+    else if (s == "0") mode = EofMode::Zero;
+    else if (s == "-1") mode = EofMode::MinusOne;
+    else return false;
+    return true;
+}
+
+// 输入缓冲区的内存布局，解释器和生成的代码（PE/ELF/JIT）共用：头部之后紧跟容量字节的数据。
+// data[pos, len) 是已读入还没取用的字节；取完时先写出待输出的内容，再用一次 read/ReadFile 读满
+struct InputHeader {
+    uint64_t pos;
+    uint64_t len;
+};
+
+} // namespace bf
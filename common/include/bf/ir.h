@@ -10,15 +10,26 @@ enum class IRType {
     AddVal,     // + - 合并
     Output,     // .
     Input,      // ,
-    LoopBegin,  // [
-    LoopEnd,    // ]
+    LoopBegin,  // [ 判断 cell[offset]
+    LoopEnd,    // ] 判断 cell[offset]
     SetZero,    // [-] 或 [+]
+    MulAdd,     // [->+>++<<] 乘法/拷贝循环: cell[offset] += cell[src_offset] * operand
+    ScanZero,   // [>] [<<] 扫描循环: while (cell[0]) ptr += operand
+    SetVal,     // 已知值传播的结果: cell[offset] = operand
 };
 
 struct IRInst {
     IRType type;
     int operand = 0;       // MovePtr/AddVal 的偏移量
     int jump_target = -1;  // LoopBegin/LoopEnd 的配对索引
+    int offset = 0;        // 访存指令相对数据指针的偏移；MulAdd 为目标单元格偏移，循环为判断的单元格
+    int src_offset = 0;    // MulAdd 源单元格的偏移
+};
+
+// 源码位置，行列号均从 1 开始；0 表示未知
+struct SourceLoc {
+    int32_t line = 0;
+    int32_t col = 0;
 };
 
 std::string ir_type_name(IRType type);
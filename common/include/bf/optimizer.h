@@ -1,13 +1,39 @@
 #pragma once
 #include "ir.h"
+#include "packed_ir.h"
+#include <cstdint>
 #include <vector>
 
 namespace bf {
 
+// 优化后的代码在数据指针位于 tape 内时，访问的地址不会超出 tape 两侧各 TAPE_MARGIN 字节。
+// (MulAdd 在源单元格为 0 时仍会访问目标单元格，ScanZero 的 SIMD 实现会整块读取。)
+// 各后端需要在 tape 前后各预留这么多字节。
+constexpr int TAPE_MARGIN = 64;
+
+// tape 的单元格数，所有后端一致
+constexpr int TAPE_SIZE = 30000;
+
+// 可增长 tape（解释器和 Linux ELF 后端）在原点两侧各保留的虚拟地址空间字节数。
+// 页面在首次访问时才分配，原点左侧同样可用；partial_evaluate 只模拟前 TAPE_SIZE 个单元格
+constexpr uint32_t TAPE_RESERVE = 256u << 20;
+
+// 单元格位数 8/16/32，算术以 2^bits 为模；tape 的边距和偏移都以单元格为单位
+inline bool valid_cell_bits(int bits) { return bits == 8 || bits == 16 || bits == 32; }
+inline uint32_t cell_mask(int bits) { return bits >= 32 ? 0xFFFFFFFFu : (1u << bits) - 1; }
+
 // 对IR指令序列进行优化
 // - 连续指令合并 (MovePtr, AddVal)
-// - 清零循环识别 [-] [+]
-// - 死代码消除 (开头的循环)
-std::vector<IRInst> optimize(const std::vector<IRInst>& program);
+// - 清零循环识别 [-] [+] 及其他奇数步长
+// - 乘法/拷贝循环识别 [->+>++<<] -> MulAdd... SetZero，奇数步长按模 2^cell_bits 求逆
+// - 扫描循环识别 [>] [<<] -> ScanZero
+// - 指针移动下沉到访存指令的 offset，每个基本块只保留一条 MovePtr；
+//   指针净移动为 0 的平衡循环整个被穿过，循环内不再有 MovePtr，循环判断和 MulAdd 也带偏移
+// - 已知值传播：SetZero+AddVal 折叠为 SetVal，删除多余的写入和当前单元格已知为 0 的循环
+// cell_bits 决定折叠和常量计算使用的模数，必须与执行时的单元格宽度一致
+void optimize_in_place(PackedProgram& program, int cell_bits = 8);
+
+// 同上，输入输出为 IRInst 数组（内部转为 PackedProgram 处理）
+std::vector<IRInst> optimize(const std::vector<IRInst>& program, int cell_bits = 8);
 
 } // namespace bf
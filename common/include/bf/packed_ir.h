@@ -0,0 +1,89 @@
+#pragma once
+#include "ir.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace bf {
+
+// 紧凑的结构数组 (SoA) 形式的 IR，每条指令占 13 字节（IRInst 为 20 字节）：
+// - ops:     uint8_t 操作码流（IRType）
+// - args:    MovePtr/AddVal/MulAdd/ScanZero/SetVal 的 operand；LoopBegin/LoopEnd 的配对索引
+// - offsets: 访存指令相对数据指针的偏移，循环指令为判断的单元格偏移
+// - src_offsets: MulAdd 源单元格的偏移，其余指令为 0
+// 循环指令没有 operand，其余指令没有 jump_target，所以两者共用 args。
+// 优化遍在原数组上用读写双指针压缩改写，只会缩短程序，不会重新分配。
+// track_locs 为 true 时 locs 与 ops 等长，记录每条指令来自的源码位置（供 --profile 使用）。
+struct PackedProgram {
+    std::vector<uint8_t> ops;
+    std::vector<int32_t> args;
+    std::vector<int32_t> offsets;
+    std::vector<int32_t> src_offsets;
+    std::vector<SourceLoc> locs;
+    bool track_locs = false;
+
+    size_t size() const { return ops.size(); }
+    bool empty() const { return ops.empty(); }
+
+    IRType type(size_t i) const { return static_cast<IRType>(ops[i]); }
+
+    SourceLoc loc(size_t i) const { return track_locs ? locs[i] : SourceLoc{}; }
+
+    void push_back(IRType type, int32_t arg = 0, int32_t offset = 0, SourceLoc loc = {}) {
+        ops.push_back(static_cast<uint8_t>(type));
+        args.push_back(arg);
+        offsets.push_back(offset);
+        src_offsets.push_back(0);
+        if (track_locs) locs.push_back(loc);
+    }
+
+    void pop_back() {
+        ops.pop_back();
+        args.pop_back();
+        offsets.pop_back();
+        src_offsets.pop_back();
+        if (track_locs) locs.pop_back();
+    }
+
+    // 把第 from 条指令搬到第 to 条（to <= from），供原地压缩使用
+    void move(size_t to, size_t from) {
+        ops[to] = ops[from];
+        args[to] = args[from];
+        offsets[to] = offsets[from];
+        src_offsets[to] = src_offsets[from];
+        if (track_locs) locs[to] = locs[from];
+    }
+
+    // 改写第 i 条指令，源码位置设为 loc；MulAdd 的源单元格偏移设为 0
+    void set(size_t i, IRType type, int32_t arg, int32_t offset, SourceLoc loc) {
+        ops[i] = static_cast<uint8_t>(type);
+        args[i] = arg;
+        offsets[i] = offset;
+        src_offsets[i] = 0;
+        if (track_locs) locs[i] = loc;
+    }
+
+    // 截断到 n 条指令，容量保持不变
+    void truncate(size_t n) {
+        ops.resize(n);
+        args.resize(n);
+        offsets.resize(n);
+        src_offsets.resize(n);
+        if (track_locs) locs.resize(n);
+    }
+
+    void reserve(size_t n) {
+        ops.reserve(n);
+        args.reserve(n);
+        offsets.reserve(n);
+        src_offsets.reserve(n);
+        if (track_locs) locs.reserve(n);
+    }
+
+    IRInst at(size_t i) const;
+};
+
+PackedProgram pack(const std::vector<IRInst>& program);
+std::vector<IRInst> unpack(const PackedProgram& program);
+
+} // namespace bf
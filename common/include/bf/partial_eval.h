@@ -0,0 +1,28 @@
+#pragma once
+#include "packed_ir.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bf {
+
+// 编译期部分求值的结果：程序开头与输入无关的一段已经执行完，
+// 生成的代码从这个状态继续运行
+struct Snapshot {
+    std::string output;        // 已执行部分的输出，在程序开头作为静态字符串一次写出
+    std::vector<uint8_t> tape; // 执行后的 tape（TAPE_SIZE 个单元格，小端字节序），为空表示全 0
+    int32_t pointer = 0;       // 继续执行时的数据指针
+    uint64_t steps = 0;        // 编译期执行的指令数
+
+    bool empty() const { return output.empty() && tape.empty() && pointer == 0; }
+};
+
+// 在编译期执行程序，直到遇到第一条 Input、执行了 max_steps 条指令或程序结束。
+// 只在顶层（不在任何循环内）的指令处停下：在循环内停下时回退到进入该顶层循环之前的状态。
+// 访问超出 tape 的单元格时同样停下，留给运行时处理。
+// 已执行的指令从 program 中删除，program 变为从快照继续执行的剩余部分；
+// 程序整个执行完时 program 为空，快照只剩输出。max_steps 为 0 时不做任何事。
+// cell_bits 为单元格位数 (8/16/32)，与 optimize_in_place 使用的一致。
+Snapshot partial_evaluate(PackedProgram& program, uint64_t max_steps, int cell_bits = 8);
+
+} // namespace bf
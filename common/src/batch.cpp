@@ -0,0 +1,151 @@
+#include "bf/batch.h"
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace bf {
+
+static void expand_path(const std::string& path, std::vector<std::string>& files) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    if (!fs::is_directory(path, ec)) {
+        files.push_back(path);
+        return;
+    }
+    std::vector<std::string> found;
+    for (const auto& entry : fs::directory_iterator(path)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".bf")
+            found.push_back(entry.path().string());
+    }
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+std::vector<std::string> expand_inputs(const std::vector<std::string>& args) {
+    std::vector<std::string> files;
+    for (const auto& arg : args) {
+        if (arg.empty() || arg[0] != '@') {
+            expand_path(arg, files);
+            continue;
+        }
+        std::ifstream list(arg.substr(1));
+        if (!list) throw std::runtime_error("cannot open list file '" + arg.substr(1) + "'");
+        std::string line;
+        while (std::getline(list, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+            expand_path(line, files);
+        }
+    }
+    return files;
+}
+
+std::vector<BatchError> take_output_conflicts(std::vector<std::string>& inputs,
+                                              const std::function<std::string(const std::string&)>& output_of) {
+    std::vector<std::string> outputs;
+    std::map<std::string, std::vector<size_t>> users;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        outputs.push_back(std::filesystem::path(output_of(inputs[i])).lexically_normal().string());
+        users[outputs.back()].push_back(i);
+    }
+
+    std::vector<BatchError> result;
+    std::vector<std::string> kept;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        const auto& group = users[outputs[i]];
+        if (group.size() == 1) {
+            kept.push_back(inputs[i]);
+            continue;
+        }
+        const std::string& other = inputs[group[0] == i ? group[1] : group[0]];
+        result.push_back({inputs[i], "output '" + outputs[i] + "' is also produced by '" + other + "'"});
+    }
+    inputs = std::move(kept);
+    return result;
+}
+
+namespace {
+
+// 每个线程一个任务队列：所有者从头部取，窃取者从尾部取
+struct WorkQueue {
+    std::mutex mutex;
+    std::deque<size_t> items;
+
+    bool pop_front(size_t& item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (items.empty()) return false;
+        item = items.front();
+        items.pop_front();
+        return true;
+    }
+
+    bool pop_back(size_t& item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (items.empty()) return false;
+        item = items.back();
+        items.pop_back();
+        return true;
+    }
+};
+
+} // namespace
+
+std::vector<BatchError> run_batch(const std::vector<std::string>& inputs, unsigned jobs,
+                                  const std::function<void(const std::string&)>& job) {
+    if (jobs == 0) jobs = std::max(1u, std::thread::hardware_concurrency());
+    jobs = static_cast<unsigned>(std::min<size_t>(jobs, std::max<size_t>(inputs.size(), 1)));
+
+    // 连续的块分给同一线程，相邻输入（通常在同一目录）留在同一个核上
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    for (unsigned w = 0; w < jobs; ++w) {
+        queues.push_back(std::make_unique<WorkQueue>());
+        size_t begin = inputs.size() * w / jobs, end = inputs.size() * (w + 1) / jobs;
+        for (size_t i = begin; i < end; ++i) queues[w]->items.push_back(i);
+    }
+
+    // 每个输入只由一个线程处理，各自写入自己的槽位，无需加锁
+    std::vector<std::string> errors(inputs.size());
+    std::vector<char> failed(inputs.size(), 0);
+
+    auto worker = [&](unsigned self) {
+        size_t item;
+        for (;;) {
+            bool found = queues[self]->pop_front(item);
+            for (unsigned k = 1; !found && k < jobs; ++k) {
+                found = queues[(self + k) % jobs]->pop_back(item);
+            }
+            // 任务不会再产生新任务，所有队列都空了就可以退出
+            if (!found) return;
+            try {
+                job(inputs[item]);
+            } catch (const std::exception& e) {
+                errors[item] = e.what();
+                failed[item] = 1;
+            } catch (...) {
+                errors[item] = "unknown error";
+                failed[item] = 1;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned w = 1; w < jobs; ++w) threads.emplace_back(worker, w);
+    worker(0);
+    for (auto& t : threads) t.join();
+
+    std::vector<BatchError> result;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        if (failed[i]) result.push_back({inputs[i], errors[i]});
+    }
+    return result;
+}
+
+} // namespace bf
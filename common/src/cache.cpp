@@ -0,0 +1,166 @@
+#include "bf/cache.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace bf {
+
+namespace fs = std::filesystem;
+
+// SHA-256 (FIPS 180-4)，只用于生成缓存键
+namespace {
+
+class Sha256 {
+public:
+    void update(const void* data, size_t len) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        total_ += len;
+        while (len > 0) {
+            size_t n = std::min(len, sizeof(block_) - used_);
+            std::copy(p, p + n, block_ + used_);
+            used_ += n;
+            p += n;
+            len -= n;
+            if (used_ == sizeof(block_)) {
+                compress();
+                used_ = 0;
+            }
+        }
+    }
+
+    std::string hex_digest() {
+        uint64_t bits = total_ * 8;
+        uint8_t pad = 0x80;
+        update(&pad, 1);
+        pad = 0;
+        while (used_ != 56) update(&pad, 1);
+        uint8_t len[8];
+        for (int i = 0; i < 8; ++i) len[i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+        update(len, 8);
+
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        for (uint32_t v : h_) {
+            for (int shift = 28; shift >= 0; shift -= 4) hex += digits[(v >> shift) & 0xF];
+        }
+        return hex;
+    }
+
+private:
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void compress() {
+        static const uint32_t K[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+        };
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = uint32_t{block_[4 * i]} << 24 | uint32_t{block_[4 * i + 1]} << 16 |
+                   uint32_t{block_[4 * i + 2]} << 8 | uint32_t{block_[4 * i + 3]};
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h_[0], b = h_[1], c = h_[2], d = h_[3];
+        uint32_t e = h_[4], f = h_[5], g = h_[6], h = h_[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+        h_[0] += a; h_[1] += b; h_[2] += c; h_[3] += d;
+        h_[4] += e; h_[5] += f; h_[6] += g; h_[7] += h;
+    }
+
+    uint32_t h_[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    uint8_t block_[64];
+    size_t used_ = 0;
+    uint64_t total_ = 0;
+};
+
+} // namespace
+
+CompileCache::CompileCache(std::string dir) : dir_(dir.empty() ? default_dir() : std::move(dir)) {}
+
+std::string CompileCache::default_dir() {
+#ifdef _WIN32
+    if (const char* local = std::getenv("LOCALAPPDATA"); local && *local)
+        return (fs::path(local) / "bfcompiler").string();
+#endif
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+        return (fs::path(xdg) / "bfcompiler").string();
+    if (const char* home = std::getenv("HOME"); home && *home)
+        return (fs::path(home) / ".cache" / "bfcompiler").string();
+    return (fs::temp_directory_path() / "bfcompiler").string();
+}
+
+std::string CompileCache::key(const std::vector<char>& tokens, const std::string& config) {
+    Sha256 sha;
+    std::string header = "bfcache " + std::to_string(CACHE_VERSION) + "\n" + config + "\n";
+    sha.update(header.data(), header.size());
+    sha.update(tokens.data(), tokens.size());
+    return sha.hex_digest();
+}
+
+// 条目按键的前两位分到 256 个子目录
+std::string CompileCache::entry_path(const std::string& key) const {
+    return (fs::path(dir_) / key.substr(0, 2) / key.substr(2)).string();
+}
+
+bool CompileCache::fetch(const std::string& key, const std::string& output) const {
+    const std::string entry = entry_path(key);
+    std::error_code ec;
+    if (!fs::is_regular_file(entry, ec)) return false;
+    // 先删除 output 再复制：output 若是指向其他文件的硬链接，覆盖写会改到那个文件
+    fs::remove(output, ec);
+    return fs::copy_file(entry, output, fs::copy_options::overwrite_existing, ec);
+}
+
+void CompileCache::store(const std::string& key, const std::string& output) const {
+    static std::atomic<unsigned> counter{0};
+    static const unsigned salt = std::random_device{}();
+    const fs::path entry = entry_path(key);
+    std::error_code ec;
+    fs::create_directories(entry.parent_path(), ec);
+    if (ec) return;
+
+    // 临时文件名在进程和线程之间唯一，改名是原子的，读者不会看到写了一半的条目
+    std::ostringstream tmp_name;
+    tmp_name << entry.filename().string() << ".tmp." << salt << "."
+             << std::this_thread::get_id() << "." << counter++;
+    fs::path tmp = entry.parent_path() / tmp_name.str();
+    if (!fs::copy_file(output, tmp, fs::copy_options::overwrite_existing, ec)) {
+        fs::remove(tmp, ec);
+        return;
+    }
+    fs::rename(tmp, entry, ec);
+    if (ec) fs::remove(tmp, ec);
+}
+
+std::string read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("cannot open file '" + path + "'");
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+} // namespace bf
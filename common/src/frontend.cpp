@@ -0,0 +1,183 @@
+#include "bf/frontend.h"
+#include <stack>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace bf {
+
+// 根据字节偏移计算行列号，只在报错时使用
+static SourceLoc locate(const char* data, size_t pos) {
+    SourceLoc loc{1, 1};
+    for (size_t i = 0; i < pos; ++i) {
+        if (data[i] == '\n') {
+            ++loc.line;
+            loc.col = 1;
+        } else {
+            ++loc.col;
+        }
+    }
+    return loc;
+}
+
+static std::string describe(const char* data, size_t pos) {
+    SourceLoc loc = locate(data, pos);
+    return " at line " + std::to_string(loc.line) + ", column " + std::to_string(loc.col);
+}
+
+// TrackLocs 为 false 时行列号的维护在编译期去掉
+template <bool TrackLocs>
+static PackedProgram parse_impl(const char* data, size_t size) {
+    PackedProgram program;
+    program.track_locs = TrackLocs;
+    std::stack<int> loop_stack;
+    std::stack<size_t> open_pos; // 各 '[' 的字节偏移，用于报错
+    SourceLoc loc{1, 1};
+
+    // 与上一条同类指令合并，合并为 0 时删除（删除的只可能是 MovePtr/AddVal）
+    // 合并后的指令保留第一个字符的位置
+    auto merge = [&](IRType type, int delta) {
+        if (!program.empty() && program.type(program.size() - 1) == type) {
+            program.args.back() += delta;
+            if (program.args.back() == 0) program.pop_back();
+        } else {
+            program.push_back(type, delta, 0, loc);
+        }
+    };
+
+    for (size_t i = 0; i < size; ++i) {
+        switch (data[i]) {
+            case '>': merge(IRType::MovePtr, 1);  break;
+            case '<': merge(IRType::MovePtr, -1); break;
+            case '+': merge(IRType::AddVal, 1);   break;
+            case '-': merge(IRType::AddVal, -1);  break;
+            case '.': program.push_back(IRType::Output, 0, 0, loc); break;
+            case ',': program.push_back(IRType::Input, 0, 0, loc);  break;
+            case '[':
+                loop_stack.push(static_cast<int>(program.size()));
+                open_pos.push(i);
+                program.push_back(IRType::LoopBegin, -1, 0, loc);
+                break;
+            case ']': {
+                if (loop_stack.empty()) {
+                    throw std::runtime_error("Unmatched ']' found" + describe(data, i));
+                }
+                int open = loop_stack.top();
+                loop_stack.pop();
+                open_pos.pop();
+                program.push_back(IRType::LoopEnd, open, 0, loc);
+                program.args[open] = static_cast<int>(program.size()) - 1;
+                break;
+            }
+            default: break;
+        }
+        if constexpr (TrackLocs) {
+            if (data[i] == '\n') {
+                ++loc.line;
+                loc.col = 1;
+            } else {
+                ++loc.col;
+            }
+        }
+    }
+
+    if (!loop_stack.empty()) {
+        throw std::runtime_error("Unmatched '[' found" + describe(data, open_pos.top()));
+    }
+
+    return program;
+}
+
+PackedProgram parse_source(const char* data, size_t size, bool track_locs) {
+    return track_locs ? parse_impl<true>(data, size) : parse_impl<false>(data, size);
+}
+
+#ifdef _WIN32
+
+PackedProgram parse_file(const std::string& path, bool track_locs) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("cannot open file '" + path + "'");
+    }
+    LARGE_INTEGER size{};
+    GetFileSizeEx(file, &size);
+    if (size.QuadPart == 0) {
+        CloseHandle(file);
+        PackedProgram empty;
+        empty.track_locs = track_locs;
+        return empty;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const char* data = mapping
+        ? static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0))
+        : nullptr;
+    if (!data) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error("cannot map file '" + path + "'");
+    }
+
+    PackedProgram program;
+    try {
+        program = parse_source(data, static_cast<size_t>(size.QuadPart), track_locs);
+    } catch (...) {
+        UnmapViewOfFile(data);
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw;
+    }
+    UnmapViewOfFile(data);
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return program;
+}
+
+#else
+
+PackedProgram parse_file(const std::string& path, bool track_locs) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open file '" + path + "'");
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("cannot stat file '" + path + "'");
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size == 0) {
+        close(fd);
+        PackedProgram empty;
+        empty.track_locs = track_locs;
+        return empty;
+    }
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("cannot map file '" + path + "'");
+    }
+    // 顺序读一遍，允许内核预读并尽早回收读过的页
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    PackedProgram program;
+    try {
+        program = parse_source(static_cast<const char*>(data), size, track_locs);
+    } catch (...) {
+        munmap(data, size);
+        throw;
+    }
+    munmap(data, size);
+    return program;
+}
+
+#endif
+
+} // namespace bf
@@ -11,6 +11,9 @@ std::string ir_type_name(IRType type) {
         case IRType::LoopBegin: return "LoopBegin";
         case IRType::LoopEnd:   return "LoopEnd";
         case IRType::SetZero:   return "SetZero";
+        case IRType::MulAdd:    return "MulAdd";
+        case IRType::ScanZero:  return "ScanZero";
+        case IRType::SetVal:    return "SetVal";
     }
     return "Unknown";
 }
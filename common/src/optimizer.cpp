@@ -1,88 +1,434 @@
 #include "bf/optimizer.h"
+#include <algorithm>
+#include <map>
 #include <stack>
+#include <utility>
 
 namespace bf {
 
-// 第一遍：合并连续的 MovePtr 和 AddVal
-static std::vector<IRInst> merge_consecutive(const std::vector<IRInst>& program) {
-    std::vector<IRInst> result;
-    for (const auto& inst : program) {
-        if (!result.empty() && result.back().type == inst.type &&
-            (inst.type == IRType::MovePtr || inst.type == IRType::AddVal)) {
-            result.back().operand += inst.operand;
+// 所有优化遍都用读指针 i、写指针 w 在原数组上压缩改写，每一遍都保证 w <= i，
+// 结束时截断到 w，不产生新的数组。
+// 单元格的算术以 2^bits 为模（bits 为 8/16/32），值都用 uint32_t 存放并按 mask 截断。
+
+// 把模 2^bits 的值换成 int32_t 表示：bits < 32 时取 [-2^(bits-1), 2^(bits-1)) 中的代表元
+static int32_t to_signed(uint32_t v, uint32_t mask) {
+    v &= mask;
+    if (mask != 0xFFFFFFFFu && v > mask / 2) return static_cast<int32_t>(v) - static_cast<int32_t>(mask) - 1;
+    return static_cast<int32_t>(v);
+}
+
+// 奇数 a 模 2^32 的乘法逆元（牛顿迭代，每次精度翻倍），再截断到 mask 即为模 2^bits 的逆元
+static uint32_t odd_inverse(uint32_t a) {
+    uint32_t x = a; // a * a ≡ 1 (mod 8)，已有 3 位精度
+    for (int k = 0; k < 4; ++k) x *= 2 - a * x;
+    return x;
+}
+
+// 第一遍：合并连续的 MovePtr 和 AddVal，AddVal 的增量按模数归一化
+static void merge_consecutive(PackedProgram& p, uint32_t mask) {
+    size_t w = 0;
+    for (size_t i = 0; i < p.size(); ++i) {
+        IRType t = p.type(i);
+        if (w > 0 && p.type(w - 1) == t &&
+            (t == IRType::MovePtr || t == IRType::AddVal)) {
+            p.args[w - 1] += p.args[i];
+            if (t == IRType::AddVal) p.args[w - 1] = to_signed(p.args[w - 1], mask);
             // 如果合并后为0，移除
-            if (result.back().operand == 0) {
-                result.pop_back();
-            }
+            if (p.args[w - 1] == 0) --w;
         } else {
-            result.push_back(inst);
+            p.move(w++, i);
+            if (t == IRType::AddVal) {
+                p.args[w - 1] = to_signed(p.args[w - 1], mask);
+                if (p.args[w - 1] == 0) --w;
+            }
         }
     }
-    return result;
+    p.truncate(w);
 }
 
-// 第二遍：识别清零循环 [-] 和 [+]
-static std::vector<IRInst> detect_set_zero(const std::vector<IRInst>& program) {
-    std::vector<IRInst> result;
-    for (size_t i = 0; i < program.size(); ++i) {
-        if (i + 2 < program.size() &&
-            program[i].type == IRType::LoopBegin &&
-            program[i + 1].type == IRType::AddVal &&
-            (program[i + 1].operand == 1 || program[i + 1].operand == -1) &&
-            program[i + 2].type == IRType::LoopEnd) {
-            IRInst sz{};
-            sz.type = IRType::SetZero;
-            result.push_back(sz);
+// 第二遍：识别清零循环 [-] [+] [---]
+// 步长为奇数时，模 2^bits 下任何初值都恰好在某次迭代后变为 0；偶数步长对奇数初值永不结束
+static void detect_set_zero(PackedProgram& p) {
+    size_t w = 0;
+    for (size_t i = 0; i < p.size(); ++i) {
+        if (i + 2 < p.size() &&
+            p.type(i) == IRType::LoopBegin &&
+            p.type(i + 1) == IRType::AddVal &&
+            (p.args[i + 1] & 1) != 0 &&
+            p.type(i + 2) == IRType::LoopEnd) {
+            p.set(w++, IRType::SetZero, 0, 0, p.loc(i));
             i += 2; // 跳过 AddVal 和 LoopEnd
         } else {
-            result.push_back(program[i]);
+            p.move(w++, i);
+        }
+    }
+    p.truncate(w);
+}
+
+// 第三遍：识别乘法/拷贝循环，如 [->+>++<<]、[--->+<]
+// 条件：循环体只含 MovePtr/AddVal，指针净移动为0，且循环单元格每次迭代的增量 s 为奇数。
+// 循环执行 n 次，v + n*s ≡ 0，即 n ≡ -v * s^-1 (mod 2^bits)，
+// 等价于对每个偏移 k 执行 cell[k] += cell[0] * (-delta * s^-1)，最后 cell[0] = 0。
+// cell[0] 为 0 时原循环不会访问目标单元格，而折叠后仍会访问（加 0），目标可能位于
+// tape 之外（如 tape 开头的 [-<+>]）。偏移都在 TAPE_MARGIN 以内时由后端预留的边距兜底，
+// 否则把折叠结果包在 LoopBegin/LoopEnd 里（只会执行一次）。
+// 循环体至少含一条 AddVal(步长) 和两条 MovePtr，折叠结果不会比原循环长。
+static void detect_mul_loops(PackedProgram& p, uint32_t mask) {
+    std::vector<std::pair<int, int>> deltas; // (偏移, 增量)，各循环复用
+    size_t w = 0;
+    for (size_t i = 0; i < p.size(); ++i) {
+        if (p.type(i) != IRType::LoopBegin) {
+            p.move(w++, i);
+            continue;
+        }
+
+        // 扫描到第一个非 MovePtr/AddVal 指令，只有最内层的简单循环会停在 LoopEnd
+        deltas.clear();
+        int ptr = 0;
+        size_t j = i + 1;
+        for (; j < p.size(); ++j) {
+            if (p.type(j) == IRType::MovePtr) {
+                ptr += p.args[j];
+            } else if (p.type(j) == IRType::AddVal) {
+                auto it = std::find_if(deltas.begin(), deltas.end(),
+                                       [&](const auto& d) { return d.first == ptr; });
+                if (it != deltas.end())
+                    it->second += p.args[j];
+                else
+                    deltas.emplace_back(ptr, p.args[j]);
+            } else {
+                break;
+            }
+        }
+
+        auto self = std::find_if(deltas.begin(), deltas.end(),
+                                 [](const auto& d) { return d.first == 0; });
+        int step = self != deltas.end() ? self->second : 0;
+        if (j >= p.size() || p.type(j) != IRType::LoopEnd ||
+            ptr != 0 || (step & 1) == 0) {
+            p.move(w++, i);
+            continue;
+        }
+
+        // 因子 -delta * s^-1；32 位下 -2^31 没有对应的正数，这种循环保留原样
+        uint32_t inv = odd_inverse(static_cast<uint32_t>(step));
+        bool foldable = true;
+        for (auto& [off, delta] : deltas) {
+            if (off == 0) continue;
+            delta = to_signed(0u - static_cast<uint32_t>(delta) * inv, mask);
+            if (delta == INT32_MIN) foldable = false;
+        }
+        if (!foldable) {
+            p.move(w++, i);
+            continue;
+        }
+
+        std::sort(deltas.begin(), deltas.end());
+        bool guarded = false;
+        for (const auto& [off, delta] : deltas) {
+            if (off != 0 && delta != 0 && (off < -TAPE_MARGIN || off > TAPE_MARGIN)) guarded = true;
+        }
+
+        // 折叠结果记在循环 '[' 的源码位置上
+        SourceLoc loc = p.loc(i);
+        SourceLoc end_loc = p.loc(j);
+        if (guarded) p.set(w++, IRType::LoopBegin, 0, 0, loc);
+        for (const auto& [off, delta] : deltas) {
+            if (off == 0 || delta == 0) continue;
+            p.set(w++, IRType::MulAdd, delta, off, loc);
+        }
+        p.set(w++, IRType::SetZero, 0, 0, loc);
+        if (guarded) p.set(w++, IRType::LoopEnd, 0, 0, end_loc);
+        i = j; // 跳过整个循环
+    }
+    p.truncate(w);
+}
+
+// 第四遍：识别扫描循环 [>] [<] [>>>>]，即循环体只有一条 MovePtr
+static void detect_scan_loops(PackedProgram& p) {
+    size_t w = 0;
+    for (size_t i = 0; i < p.size(); ++i) {
+        if (i + 2 < p.size() &&
+            p.type(i) == IRType::LoopBegin &&
+            p.type(i + 1) == IRType::MovePtr &&
+            p.type(i + 2) == IRType::LoopEnd) {
+            p.set(w++, IRType::ScanZero, p.args[i + 1], 0, p.loc(i));
+            i += 2;
+        } else {
+            p.move(w++, i);
+        }
+    }
+    p.truncate(w);
+}
+
+// 平衡循环分析：循环体（含嵌套循环）的指针净移动为 0 且不含 ScanZero 时称为平衡的，
+// 每轮迭代开始时指针都回到进入循环时的位置，循环内的每次访存都是相对入口指针的固定偏移。
+// 含有不平衡子循环的循环本身也不平衡（子循环的迭代次数决定指针位移）。
+// 返回与 p 等长的标记，平衡循环的 LoopBegin 和 LoopEnd 处为 1
+static std::vector<uint8_t> find_balanced_loops(const PackedProgram& p) {
+    struct Frame {
+        size_t begin;
+        int net;       // 本层循环体中 MovePtr 的合计
+        bool balanced; // 尚未发现 ScanZero 或不平衡的子循环
+    };
+    std::vector<uint8_t> balanced(p.size(), 0);
+    std::vector<Frame> frames{{0, 0, false}}; // 最外层的顶层代码不是循环
+    for (size_t i = 0; i < p.size(); ++i) {
+        switch (p.type(i)) {
+            case IRType::MovePtr:
+                frames.back().net += p.args[i];
+                break;
+            case IRType::ScanZero:
+                frames.back().balanced = false;
+                break;
+            case IRType::LoopBegin:
+                frames.push_back({i, 0, true});
+                break;
+            case IRType::LoopEnd: {
+                Frame f = frames.back();
+                frames.pop_back();
+                bool b = f.balanced && f.net == 0;
+                balanced[f.begin] = balanced[i] = b;
+                if (!b) frames.back().balanced = false;
+                break;
+            }
+            default:
+                break;
         }
     }
-    return result;
+    return balanced;
 }
 
-// 第三遍：死代码消除（开头的循环不会执行）
-static std::vector<IRInst> eliminate_dead_code(const std::vector<IRInst>& program) {
-    std::vector<IRInst> result;
-    size_t i = 0;
-    // 跳过开头的循环（初始值为0，不会进入）
-    while (i < program.size() && program[i].type == IRType::LoopBegin) {
-        int depth = 1;
-        ++i;
-        while (i < program.size() && depth > 0) {
-            if (program[i].type == IRType::LoopBegin) ++depth;
-            if (program[i].type == IRType::LoopEnd) --depth;
-            ++i;
+// 第五遍：把指针移动折叠进后续访存指令的 offset（MulAdd 还有 src_offset，循环为判断的单元格），
+// 只在 ScanZero 和不平衡循环的入口/出口之前输出一条合并后的 MovePtr。
+// 平衡循环的入口和出口处待输出的位移相同，可以整个穿过，于是平衡循环内不剩任何 MovePtr，
+// 后端直接按 [rbx+k] 寻址。必须在依赖 MovePtr 形式的模式识别之后运行。
+// 本遍决定了优化后 IR 中相邻指令的分布，改动后要用 bf-ngrams 重新统计，
+// 更新解释器的超级指令模式（interpreter/src/superinst.cpp）。
+// pending 非 0 说明上次输出后至少跳过了一条 MovePtr，所以补出的 MovePtr 不会追上读指针。
+static void sink_pointer_moves(PackedProgram& p) {
+    const std::vector<uint8_t> balanced = find_balanced_loops(p);
+    size_t w = 0;
+    int pending = 0;
+    SourceLoc pending_loc; // 合并后的 MovePtr 记在第一条被合并的 MovePtr 上
+    for (size_t i = 0; i < p.size(); ++i) {
+        switch (p.type(i)) {
+            case IRType::MovePtr:
+                if (pending == 0) pending_loc = p.loc(i);
+                pending += p.args[i];
+                break;
+            case IRType::MulAdd:
+                p.src_offsets[i] += pending;
+                [[fallthrough]];
+            case IRType::AddVal:
+            case IRType::SetZero:
+            case IRType::SetVal:
+            case IRType::Output:
+            case IRType::Input:
+                p.move(w, i);
+                p.offsets[w++] += pending;
+                break;
+            case IRType::LoopBegin:
+            case IRType::LoopEnd:
+                if (balanced[i]) {
+                    p.move(w, i);
+                    p.offsets[w++] += pending;
+                    break;
+                }
+                [[fallthrough]];
+            case IRType::ScanZero:
+                if (pending != 0) {
+                    p.set(w++, IRType::MovePtr, pending, 0, pending_loc);
+                    pending = 0;
+                }
+                p.move(w++, i);
+                break;
         }
     }
-    // 复制剩余指令
-    for (; i < program.size(); ++i) {
-        result.push_back(program[i]);
+    // 程序末尾的指针移动没有可观察的效果，直接丢弃
+    p.truncate(w);
+}
+
+// 第六遍：已知值传播（抽象解释）
+// 沿直线代码跟踪相对当前指针的已知单元格值。程序开始时所有单元格都是 0；
+// 循环结束之后只知道它判断的单元格为 0，ScanZero 之后只知道当前单元格为 0。
+// - 对已知单元格的 AddVal/SetZero/MulAdd 不立即输出，记为待写回的值，
+//   在有指令读取该单元格或到达基本块边界时才输出一条 SetVal/SetZero，
+//   于是 SetZero+AddVal 折叠为 SetVal，常量表的构造折叠为直接存储；
+// - 写入与已知值相同的值（多余的 SetZero 等）直接删除；
+// - 循环判断的单元格已知为 0 时整个循环不会执行，直接删除（不限于程序开头）；
+// - MulAdd 的源单元格已知时变为 AddVal（为 0 时删除）；
+// - 程序末尾尚未写回的值没有可观察的效果，直接丢弃。
+// 每个待写回的值都对应至少一条被吸收的指令，所以写指针不会追上读指针。
+static void propagate_known_values(PackedProgram& p, uint32_t mask) {
+    struct Known {
+        bool valid;    // false 表示值未知（用于在 rest_zero 下标记个别未知单元格）
+        uint32_t value;
+        bool pending;  // 值尚未写入内存
+        SourceLoc loc; // 写回时使用的源码位置
+    };
+    std::map<int, Known> known; // 键为相对程序开头指针的位置 base + offset
+    int base = 0;               // 当前指针相对程序开头的位移
+    bool rest_zero = true;      // 不在 known 中的单元格是否都为 0
+
+    size_t w = 0;
+    auto store = [&](int pos, const Known& k) {
+        int off = pos - base;
+        if (k.value == 0)
+            p.set(w++, IRType::SetZero, 0, off, k.loc);
+        else
+            p.set(w++, IRType::SetVal, static_cast<int32_t>(k.value), off, k.loc);
+    };
+    auto flush_one = [&](int off) {
+        auto it = known.find(base + off);
+        if (it != known.end() && it->second.pending) {
+            store(it->first, it->second);
+            it->second.pending = false;
+        }
+    };
+    auto flush_all = [&]() {
+        for (auto& [pos, k] : known) {
+            if (k.pending) {
+                store(pos, k);
+                k.pending = false;
+            }
+        }
+    };
+    auto lookup = [&](int off, uint32_t& value) {
+        auto it = known.find(base + off);
+        if (it != known.end()) { value = it->second.value; return it->second.valid; }
+        if (rest_zero) { value = 0; return true; }
+        return false;
+    };
+    auto assign = [&](int off, uint32_t value, SourceLoc loc) {
+        value &= mask;
+        uint32_t old;
+        if (lookup(off, old) && old == value) return;
+        known[base + off] = {true, value, true, loc};
+    };
+    // 单元格被未知的值改写（调用前已写回）
+    auto forget = [&](int off) { known[base + off] = {false, 0, false, {}}; };
+    // 循环边界之后只知道 cell[off] 为 0（已在内存中）
+    auto after_loop = [&](int off) {
+        known.clear();
+        known[base + off] = {true, 0, false, {}};
+        rest_zero = false;
+    };
+
+    for (size_t i = 0; i < p.size(); ++i) {
+        IRType t = p.type(i);
+        int off = p.offsets[i];
+        int arg = p.args[i];
+        uint32_t v, src;
+        switch (t) {
+            case IRType::MovePtr: {
+                base += arg;
+                // 删除死循环后前后两条 MovePtr 可能相邻
+                if (w > 0 && p.type(w - 1) == IRType::MovePtr) {
+                    p.args[w - 1] += arg;
+                    if (p.args[w - 1] == 0) --w;
+                } else {
+                    p.move(w++, i);
+                }
+                break;
+            }
+            case IRType::AddVal:
+                if (lookup(off, v)) {
+                    assign(off, v + static_cast<uint32_t>(arg), p.loc(i));
+                } else {
+                    p.move(w++, i);
+                }
+                break;
+            case IRType::SetZero:
+            case IRType::SetVal:
+                assign(off, t == IRType::SetZero ? 0 : static_cast<uint32_t>(arg), p.loc(i));
+                break;
+            case IRType::MulAdd:
+                if (lookup(p.src_offsets[i], src)) {
+                    uint32_t delta = (src * static_cast<uint32_t>(arg)) & mask;
+                    if (delta == 0) break;
+                    if (lookup(off, v)) {
+                        assign(off, v + delta, p.loc(i));
+                    } else {
+                        p.set(w++, IRType::AddVal, to_signed(delta, mask), off, p.loc(i));
+                    }
+                } else {
+                    flush_one(off);
+                    p.move(w++, i);
+                    forget(off);
+                }
+                break;
+            case IRType::Output:
+                flush_one(off);
+                p.move(w++, i);
+                break;
+            case IRType::Input:
+                // 遇到 EOF 时部分后端保留原值，所以先写回
+                flush_one(off);
+                p.move(w++, i);
+                forget(off);
+                break;
+            case IRType::LoopBegin:
+                if (lookup(off, v) && v == 0) {
+                    // 循环不会执行，跳过到配对的 LoopEnd
+                    int depth = 1;
+                    while (depth > 0) {
+                        ++i;
+                        if (p.type(i) == IRType::LoopBegin) ++depth;
+                        if (p.type(i) == IRType::LoopEnd) --depth;
+                    }
+                    break;
+                }
+                flush_all();
+                p.move(w++, i);
+                known.clear();
+                rest_zero = false;
+                break;
+            case IRType::LoopEnd:
+                flush_all();
+                p.move(w++, i);
+                after_loop(off);
+                break;
+            case IRType::ScanZero:
+                flush_all();
+                p.move(w++, i);
+                after_loop(0);
+                break;
+        }
     }
-    return result;
+    p.truncate(w);
 }
 
 // 重新计算 jump_target
-static void recompute_jumps(std::vector<IRInst>& program) {
+static void recompute_jumps(PackedProgram& p) {
     std::stack<int> loop_stack;
-    for (int i = 0; i < static_cast<int>(program.size()); ++i) {
-        if (program[i].type == IRType::LoopBegin) {
+    for (int i = 0; i < static_cast<int>(p.size()); ++i) {
+        if (p.type(i) == IRType::LoopBegin) {
             loop_stack.push(i);
-        } else if (program[i].type == IRType::LoopEnd) {
+        } else if (p.type(i) == IRType::LoopEnd) {
             int open = loop_stack.top();
             loop_stack.pop();
-            program[i].jump_target = open;
-            program[open].jump_target = i;
+            p.args[i] = open;
+            p.args[open] = i;
         }
     }
 }
 
-std::vector<IRInst> optimize(const std::vector<IRInst>& program) {
-    auto result = merge_consecutive(program);
-    result = detect_set_zero(result);
-    result = eliminate_dead_code(result);
-    recompute_jumps(result);
-    return result;
+void optimize_in_place(PackedProgram& program, int cell_bits) {
+    const uint32_t mask = cell_mask(cell_bits);
+    merge_consecutive(program, mask);
+    detect_set_zero(program);
+    detect_mul_loops(program, mask);
+    detect_scan_loops(program);
+    sink_pointer_moves(program);
+    propagate_known_values(program, mask);
+    recompute_jumps(program);
+}
+
+std::vector<IRInst> optimize(const std::vector<IRInst>& program, int cell_bits) {
+    PackedProgram packed = pack(program);
+    optimize_in_place(packed, cell_bits);
+    return unpack(packed);
 }
 
 } // namespace bf
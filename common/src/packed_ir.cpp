@@ -0,0 +1,41 @@
+#include "bf/packed_ir.h"
+
+namespace bf {
+
+static bool is_loop(IRType type) {
+    return type == IRType::LoopBegin || type == IRType::LoopEnd;
+}
+
+IRInst PackedProgram::at(size_t i) const {
+    IRInst inst{};
+    inst.type = type(i);
+    if (is_loop(inst.type))
+        inst.jump_target = args[i];
+    else
+        inst.operand = args[i];
+    inst.offset = offsets[i];
+    inst.src_offset = src_offsets[i];
+    return inst;
+}
+
+PackedProgram pack(const std::vector<IRInst>& program) {
+    PackedProgram packed;
+    packed.reserve(program.size());
+    for (const auto& inst : program) {
+        packed.push_back(inst.type, is_loop(inst.type) ? inst.jump_target : inst.operand,
+                         inst.offset);
+        packed.src_offsets.back() = inst.src_offset;
+    }
+    return packed;
+}
+
+std::vector<IRInst> unpack(const PackedProgram& program) {
+    std::vector<IRInst> result;
+    result.reserve(program.size());
+    for (size_t i = 0; i < program.size(); ++i) {
+        result.push_back(program.at(i));
+    }
+    return result;
+}
+
+} // namespace bf
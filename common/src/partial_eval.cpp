@@ -0,0 +1,127 @@
+#include "bf/partial_eval.h"
+#include "bf/optimizer.h"
+#include <cstring>
+
+namespace bf {
+
+template <typename Cell>
+static Snapshot evaluate(PackedProgram& p, uint64_t max_steps) {
+    Snapshot snap;
+    std::vector<Cell> tape(TAPE_SIZE, 0);
+    int ptr = 0;
+    std::string out;
+    uint64_t steps = 0;
+
+    // 进入当前顶层循环之前的状态，在循环内停下时回退到这里
+    std::vector<Cell> saved_tape;
+    int saved_ptr = 0;
+    size_t saved_out = 0;
+    size_t saved_ip = 0;
+
+    const size_t n = p.size();
+    size_t ip = 0;
+    int depth = 0; // 当前所在的循环层数
+    auto in_tape = [](int cell) { return cell >= 0 && cell < TAPE_SIZE; };
+
+    while (ip < n && steps < max_steps) {
+        int32_t arg = p.args[ip];
+        int cell = ptr + p.offsets[ip];
+        bool stop = false;
+        switch (p.type(ip)) {
+            case IRType::MovePtr:
+                ptr += arg;
+                break;
+            case IRType::AddVal:
+                if (!in_tape(cell)) { stop = true; break; }
+                tape[cell] += static_cast<Cell>(arg);
+                break;
+            case IRType::SetZero:
+            case IRType::SetVal:
+                if (!in_tape(cell)) { stop = true; break; }
+                tape[cell] = static_cast<Cell>(p.type(ip) == IRType::SetVal ? arg : 0);
+                break;
+            case IRType::MulAdd: {
+                int src = ptr + p.src_offsets[ip];
+                if (!in_tape(src)) { stop = true; break; }
+                if (tape[src] == 0) break;
+                if (!in_tape(cell)) { stop = true; break; }
+                tape[cell] += static_cast<Cell>(uint32_t{tape[src]} * static_cast<uint32_t>(arg));
+                break;
+            }
+            case IRType::ScanZero: {
+                // 扫出 tape 时停在这条 ScanZero 上，ptr 保持扫描前的值，快照指针总在 tape 内
+                int end = ptr;
+                while (in_tape(end) && tape[end] != 0) end += arg;
+                if (!in_tape(end)) { stop = true; break; }
+                ptr = end;
+                break;
+            }
+            case IRType::Output:
+                if (!in_tape(cell)) { stop = true; break; }
+                out.push_back(static_cast<char>(tape[cell]));
+                break;
+            case IRType::Input:
+                stop = true;
+                break;
+            case IRType::LoopBegin:
+                if (!in_tape(cell)) { stop = true; break; }
+                if (tape[cell] == 0) {
+                    ip = arg;
+                } else {
+                    if (depth == 0) {
+                        saved_tape = tape;
+                        saved_ptr = ptr;
+                        saved_out = out.size();
+                        saved_ip = ip;
+                    }
+                    ++depth;
+                }
+                break;
+            case IRType::LoopEnd:
+                if (!in_tape(cell)) { stop = true; break; }
+                if (tape[cell] != 0) ip = arg;
+                else --depth;
+                break;
+        }
+        if (stop) break;
+        ++ip;
+        ++steps;
+    }
+
+    if (depth > 0) {
+        // 停在循环内：回退到进入顶层循环之前
+        tape.swap(saved_tape);
+        ptr = saved_ptr;
+        out.resize(saved_out);
+        ip = saved_ip;
+    }
+    if (ip == 0) return snap;
+
+    // 删除已执行的前缀。停下的位置在顶层，剩余部分的循环都是完整配对的
+    for (size_t i = ip; i < n; ++i) {
+        p.move(i - ip, i);
+        IRType t = p.type(i - ip);
+        if (t == IRType::LoopBegin || t == IRType::LoopEnd) p.args[i - ip] -= static_cast<int32_t>(ip);
+    }
+    p.truncate(n - ip);
+
+    snap.output = std::move(out);
+    if (!p.empty()) {
+        snap.tape.resize(tape.size() * sizeof(Cell));
+        std::memcpy(snap.tape.data(), tape.data(), snap.tape.size());
+        snap.pointer = ptr;
+    }
+    snap.steps = steps;
+    return snap;
+}
+
+Snapshot partial_evaluate(PackedProgram& p, uint64_t max_steps, int cell_bits) {
+    if (max_steps == 0 || p.empty()) return {};
+    switch (cell_bits) {
+        case 16: return evaluate<uint16_t>(p, max_steps);
+        case 32: return evaluate<uint32_t>(p, max_steps);
+        default: return evaluate<uint8_t>(p, max_steps);
+    }
+}
+
+} // namespace bf
@@ -0,0 +1,55 @@
+#pragma once
+
+namespace bf {
+
+// 当前单元格 [rbx] 的寄存器缓存（cl，16/32 位单元格为 cx/ecx），由各 x86-64 后端共用的状态机：
+// - 直线代码中对 [rbx] 的 AddVal/SetZero/Output/MulAdd 源操作数都走 cl，
+//   偏移不为 0 的访存不会与 [rbx] 重叠，无需写回；
+// - MovePtr、ScanZero、Input 前把脏值写回内存并作废缓存（系统调用会破坏 rcx）；
+// - flush 子程序保存 rcx，所以 Output 不影响缓存；
+// - 循环边界的各条入边都保证 cl 有效，合并后保守地视为脏；
+//   平衡循环内判断 [rbx+k] 的循环同样先加载 cl，判断本身读内存。
+// 不变式：缓存无效时内存中的值一定是最新的。
+class CellCache {
+public:
+    explicit CellCache(bool enabled) : enabled_(enabled) {}
+
+    bool enabled() const { return enabled_; }
+
+    // cl 中是否已经是当前单元格的值
+    bool cached() const { return enabled_ && valid_; }
+
+    // 要在 cl 中使用当前单元格：返回 true 时调用方需先发出 movzx ecx, byte [rbx]
+    bool need_load() {
+        if (!enabled_ || valid_) return false;
+        valid_ = true;
+        dirty_ = false;
+        return true;
+    }
+
+    // cl 被改写（AddVal/SetZero），内存中的值过期
+    void modified() {
+        valid_ = true;
+        dirty_ = true;
+    }
+
+    // rbx 将要改变或 rcx 将被破坏：返回 true 时调用方需先发出 mov [rbx], cl
+    bool need_store_and_invalidate() {
+        bool store = enabled_ && valid_ && dirty_;
+        valid_ = false;
+        dirty_ = false;
+        return store;
+    }
+
+    // 循环入口/出口：所有入边上 cl 都有效，但是否已写回不确定
+    void loop_boundary() {
+        if (enabled_) modified();
+    }
+
+private:
+    bool enabled_;
+    bool valid_ = false;
+    bool dirty_ = false;
+};
+
+} // namespace bf
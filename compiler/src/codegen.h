@@ -1,15 +1,37 @@
 #pragma once
+#include "bf/input.h"
 #include "bf/ir.h"
 #include <string>
 #include <vector>
 #include <memory>
+#include <cstdint>
 
 namespace bf {
 
+// 各后端共享的代码生成选项
+struct CodegenOptions {
+    // 输出缓冲区字节数：Output 先写入缓冲区，满了、读输入前和退出时才整体写出
+    uint32_t out_buffer = 4096;
+    // 输入缓冲区字节数：Input 从缓冲区取字节，取完才调用一次 ReadFile/read 读满，见 bf/input.h
+    uint32_t in_buffer = 4096;
+    // 读到 EOF 时单元格的值
+    EofMode eof = EofMode::Unchanged;
+    // 把当前单元格缓存在 cl 中，只在 MovePtr、ScanZero 和 Input 前写回，见 cell_cache.h
+    bool cache_cell = true;
+    // 单元格位数 8/16/32：tape 按单元格宽度分配，访存使用 byte/word/dword 形式
+    int cell_bits = 8;
+    // 机器码后端的窥孔与分支布局：循环旋转为只在底部判断一次、复用 inc/dec/add/sub
+    // 设置的标志省去比较、rel8 短跳转和最内层循环头对齐，见 pe::finish_layout
+    bool peephole = true;
+
+    uint32_t cell_bytes() const { return static_cast<uint32_t>(cell_bits / 8); }
+};
+
 class CodeGenerator {
 public:
     virtual ~CodeGenerator() = default;
-    virtual std::string generate(const std::vector<IRInst>& program) = 0;
+    virtual std::string generate(const std::vector<IRInst>& program,
+                                 const CodegenOptions& opts) = 0;
     virtual std::string file_extension() = 0;
 };
 
@@ -1,14 +1,54 @@
 #include "codegen.h"
+#include "bf/optimizer.h"
+#include "cell_cache.h"
 #include <sstream>
 #include <stack>
 
 namespace bf {
 
+// offset(%rbx) 形式的内存操作数
+static std::string mem(int offset) {
+    if (offset == 0) return "(%rbx)";
+    return std::to_string(offset) + "(%rbx)";
+}
+
+// ScanZero 的 SSE2 候选字节掩码：步长 ±1/±2/±4 返回 pmovmskb 结果上的掩码，其余返回 0
+static int scan_mask(int stride) {
+    switch (stride) {
+        case 1: case -1: return 0xFFFF;
+        case 2:  return 0x5555;
+        case 4:  return 0x1111;
+        case -2: return 0xAAAA;
+        case -4: return 0x8888;
+    }
+    return 0;
+}
+
 class AttCodeGen : public CodeGenerator {
 public:
-    std::string generate(const std::vector<IRInst>& program) override {
+    std::string generate(const std::vector<IRInst>& program,
+                         const CodegenOptions& opts) override {
         std::ostringstream o;
         int label_id = 0;
+        int scan_id = 0;
+        int out_id = 0;
+        int in_id = 0;
+        // 单元格宽度：指令后缀为 b/w/l，缓存寄存器为 %cl/%cx/%ecx，偏移和指针移动按字节数缩放
+        const int cb = static_cast<int>(opts.cell_bytes());
+        const uint32_t cmask = cell_mask(opts.cell_bits);
+        const char sfx = cb == 1 ? 'b' : cb == 2 ? 'w' : 'l';
+        const char* creg = cb == 1 ? "%cl" : cb == 2 ? "%cx" : "%ecx";
+        const char* areg = cb == 1 ? "%al" : cb == 2 ? "%ax" : "%eax";
+        const char* load_zx = cb == 1 ? "movzbl" : cb == 2 ? "movzwl" : "movl";
+        auto cell = [&](int offset) { return mem(offset * cb); };
+        // 当前单元格缓存在 cl 中，见 cell_cache.h
+        CellCache cache(opts.cache_cell);
+        auto load_cell = [&]() {
+            if (cache.need_load()) o << "    " << load_zx << " (%rbx), %ecx\n";
+        };
+        auto spill_cell = [&]() {
+            if (cache.need_store_and_invalidate()) o << "    mov" << sfx << " " << creg << ", (%rbx)\n";
+        };
         std::stack<int> label_stack;
 
         o << "# BF Compiler output - AT&T syntax x86-64 for Windows\n";
@@ -18,14 +58,23 @@ public:
         o << ".extern ReadFile\n";
         o << ".extern ExitProcess\n\n";
         o << ".bss\n";
-        o << "tape:    .space 30000\n";
+        o << "         .space " << TAPE_MARGIN * cb << "   # tape 前后的边距\n";
+        o << "tape:    .space " << TAPE_SIZE * cb << "\n";
+        o << "         .space " << TAPE_MARGIN * cb << "\n";
         o << "written: .space 8\n";
-        o << "readcnt: .space 8\n\n";
+        o << "readcnt: .space 8\n";
+        o << "outbuf:  .space " << opts.out_buffer << "\n";
+        o << "inpos:   .space 8\n";
+        o << "inlen:   .space 8\n";
+        o << "inbuf:   .space " << opts.in_buffer << "\n\n";
         o << ".text\n";
         o << "main:\n";
         o << "    pushq %rbx\n";
         o << "    subq $48, %rsp\n";
-        o << "    leaq tape(%rip), %rbx\n\n";
+        o << "    leaq tape(%rip), %rbx\n";
+        // 输出缓冲：r15 = 缓冲区基址，r14 = 已缓冲字节数
+        o << "    leaq outbuf(%rip), %r15\n";
+        o << "    xorl %r14d, %r14d\n\n";
 
         // 获取stdout和stdin句柄
         o << "    movl $-11, %ecx\n";
@@ -39,54 +88,168 @@ public:
             const auto& inst = program[i];
             switch (inst.type) {
                 case IRType::MovePtr:
+                    spill_cell();
                     if (inst.operand > 0)
-                        o << "    addq $" << inst.operand << ", %rbx\n";
+                        o << "    addq $" << inst.operand * cb << ", %rbx\n";
                     else
-                        o << "    subq $" << -inst.operand << ", %rbx\n";
+                        o << "    subq $" << -inst.operand * cb << ", %rbx\n";
                     break;
                 case IRType::AddVal:
+                    if (inst.offset == 0 && cache.enabled()) {
+                        load_cell();
+                        uint32_t v = static_cast<uint32_t>(inst.operand) & cmask;
+                        if (v == 1)
+                            o << "    inc" << sfx << " " << creg << "\n";
+                        else if (v == cmask)
+                            o << "    dec" << sfx << " " << creg << "\n";
+                        else
+                            o << "    add" << sfx << " $" << v << ", " << creg << "\n";
+                        cache.modified();
+                        break;
+                    }
                     if (inst.operand > 0)
-                        o << "    addb $" << inst.operand << ", (%rbx)\n";
+                        o << "    add" << sfx << " $" << inst.operand << ", " << cell(inst.offset) << "\n";
                     else
-                        o << "    subb $" << -inst.operand << ", (%rbx)\n";
+                        o << "    sub" << sfx << " $" << -inst.operand << ", " << cell(inst.offset) << "\n";
                     break;
                 case IRType::SetZero:
-                    o << "    movb $0, (%rbx)\n";
+                    if (inst.offset == 0 && cache.enabled()) {
+                        o << "    xorl %ecx, %ecx\n";
+                        cache.modified();
+                        break;
+                    }
+                    o << "    mov" << sfx << " $0, " << cell(inst.offset) << "\n";
+                    break;
+                case IRType::SetVal: {
+                    uint32_t v = static_cast<uint32_t>(inst.operand) & cmask;
+                    if (inst.offset == 0 && cache.enabled()) {
+                        o << "    mov" << sfx << " $" << v << ", " << creg << "\n";
+                        cache.modified();
+                        break;
+                    }
+                    o << "    mov" << sfx << " $" << v << ", " << cell(inst.offset) << "\n";
+                    break;
+                }
+                case IRType::MulAdd: {
+                    // offset(%rbx) += src_offset(%rbx) * factor
+                    int f = inst.operand < 0 ? -inst.operand : inst.operand;
+                    if (inst.src_offset == 0) load_cell();
+                    if (inst.src_offset == 0 && cache.cached())
+                        o << "    " << load_zx << " " << creg << ", %eax\n";
+                    else
+                        o << "    " << load_zx << " " << cell(inst.src_offset) << ", %eax\n";
+                    if (f != 1)
+                        o << "    imull $" << f << ", %eax, %eax\n";
+                    // 平衡循环内目标可能就是当前单元格
+                    if (inst.offset == 0 && cache.enabled()) {
+                        load_cell();
+                        o << "    " << (inst.operand > 0 ? "add" : "sub") << sfx
+                          << " " << areg << ", " << creg << "\n";
+                        cache.modified();
+                        break;
+                    }
+                    o << "    " << (inst.operand > 0 ? "add" : "sub") << sfx
+                      << " " << areg << ", " << cell(inst.offset) << "\n";
+                    break;
+                }
+                case IRType::ScanZero: {
+                    // 8 位单元格步长 ±1/±2/±4 用 SSE2 每次检查16字节，其余逐个检查
+                    spill_cell();
+                    int id = scan_id++;
+                    int s = inst.operand;
+                    int mask = cb == 1 ? scan_mask(s) : 0;
+                    o << "    # ScanZero(" << s << ")\n";
+                    if (mask == 0) {
+                        o << ".scan_" << id << ":\n";
+                        o << "    cmp" << sfx << " $0, (%rbx)\n";
+                        o << "    je .scan_done_" << id << "\n";
+                        o << "    " << (s > 0 ? "addq $" : "subq $") << (s > 0 ? s : -s) * cb << ", %rbx\n";
+                        o << "    jmp .scan_" << id << "\n";
+                        o << ".scan_done_" << id << ":\n";
+                        break;
+                    }
+                    o << "    pxor %xmm0, %xmm0\n";
+                    o << ".scan_" << id << ":\n";
+                    o << "    movdqu " << (s > 0 ? "(%rbx)" : "-15(%rbx)") << ", %xmm1\n";
+                    o << "    pcmpeqb %xmm0, %xmm1\n";
+                    o << "    pmovmskb %xmm1, %eax\n";
+                    if (mask == 0xFFFF)
+                        o << "    testl %eax, %eax\n";
+                    else
+                        o << "    andl $" << mask << ", %eax\n";
+                    o << "    jnz .scan_found_" << id << "\n";
+                    o << "    " << (s > 0 ? "addq" : "subq") << " $16, %rbx\n";
+                    o << "    jmp .scan_" << id << "\n";
+                    o << ".scan_found_" << id << ":\n";
+                    if (s > 0) {
+                        o << "    bsfl %eax, %eax\n";
+                        o << "    addq %rax, %rbx\n";
+                    } else {
+                        o << "    bsrl %eax, %eax\n";
+                        o << "    leaq -15(%rbx,%rax), %rbx\n";
+                    }
                     break;
-                case IRType::Output:
+                }
+                case IRType::Output: {
+                    int id = out_id++;
                     o << "    # Output\n";
-                    o << "    movq %r12, %rcx\n";
-                    o << "    movq %rbx, %rdx\n";
-                    o << "    movq $1, %r8\n";
-                    o << "    leaq written(%rip), %r9\n";
-                    o << "    pushq $0\n";
-                    o << "    subq $32, %rsp\n";
-                    o << "    call WriteFile\n";
-                    o << "    addq $40, %rsp\n";
+                    if (inst.offset == 0 && cache.cached()) {
+                        o << "    movb %cl, (%r15,%r14)\n";
+                    } else {
+                        o << "    movzbl " << cell(inst.offset) << ", %eax\n";
+                        o << "    movb %al, (%r15,%r14)\n";
+                    }
+                    o << "    incq %r14\n";
+                    o << "    cmpq $" << opts.out_buffer << ", %r14\n";
+                    o << "    jb .out_" << id << "\n";
+                    o << "    call flush_out\n";
+                    o << ".out_" << id << ":\n";
                     break;
-                case IRType::Input:
+                }
+                case IRType::Input: {
+                    // read_in 在 eax 中返回下一个字节；EOF 时返回 0 或 -1，保持不变模式下为 -1
+                    const bool keep = opts.eof == EofMode::Unchanged;
+                    const bool to_cl = inst.offset == 0 && cache.enabled();
+                    int id = in_id++;
                     o << "    # Input\n";
-                    o << "    movq %r13, %rcx\n";
-                    o << "    movq %rbx, %rdx\n";
-                    o << "    movq $1, %r8\n";
-                    o << "    leaq readcnt(%rip), %r9\n";
-                    o << "    pushq $0\n";
-                    o << "    subq $32, %rsp\n";
-                    o << "    call ReadFile\n";
-                    o << "    addq $40, %rsp\n";
+                    if (!to_cl) spill_cell();
+                    else if (keep) load_cell();
+                    o << "    call read_in\n";
+                    if (keep) {
+                        o << "    testl %eax, %eax\n";
+                        o << "    js .in_" << id << "\n";
+                    }
+                    if (to_cl) {
+                        o << "    mov" << sfx << " " << areg << ", " << creg << "\n";
+                        cache.modified();
+                    } else {
+                        o << "    mov" << sfx << " " << areg << ", " << cell(inst.offset) << "\n";
+                    }
+                    if (keep) o << ".in_" << id << ":\n";
                     break;
+                }
                 case IRType::LoopBegin: {
                     int id = label_id++;
                     label_stack.push(id);
+                    load_cell();
                     o << ".loop_start_" << id << ":\n";
-                    o << "    cmpb $0, (%rbx)\n";
+                    if (cache.enabled() && inst.offset == 0)
+                        o << "    test" << sfx << " " << creg << ", " << creg << "\n";
+                    else
+                        o << "    cmp" << sfx << " $0, " << cell(inst.offset) << "\n";
+                    cache.loop_boundary();
                     o << "    je .loop_end_" << id << "\n";
                     break;
                 }
                 case IRType::LoopEnd: {
                     int id = label_stack.top();
                     label_stack.pop();
-                    o << "    cmpb $0, (%rbx)\n";
+                    load_cell();
+                    if (cache.enabled() && inst.offset == 0)
+                        o << "    test" << sfx << " " << creg << ", " << creg << "\n";
+                    else
+                        o << "    cmp" << sfx << " $0, " << cell(inst.offset) << "\n";
+                    cache.loop_boundary();
                     o << "    jne .loop_start_" << id << "\n";
                     o << ".loop_end_" << id << ":\n";
                     break;
@@ -94,8 +257,62 @@ public:
             }
         }
 
-        o << "\n    xorl %ecx, %ecx\n";
-        o << "    call ExitProcess\n";
+        o << "\n    call flush_out\n";
+        o << "    xorl %ecx, %ecx\n";
+        o << "    call ExitProcess\n\n";
+
+        // 写出 r14 字节的缓冲内容并清零计数
+        o << "flush_out:\n";
+        o << "    testq %r14, %r14\n";
+        o << "    jz .flush_done\n";
+        o << "    pushq %rcx\n";
+        o << "    subq $8, %rsp\n";
+        o << "    movq %r12, %rcx\n";
+        o << "    movq %r15, %rdx\n";
+        o << "    movq %r14, %r8\n";
+        o << "    leaq written(%rip), %r9\n";
+        o << "    pushq $0\n";
+        o << "    subq $32, %rsp\n";
+        o << "    call WriteFile\n";
+        o << "    addq $48, %rsp\n";
+        o << "    popq %rcx\n";
+        o << "    xorl %r14d, %r14d\n";
+        o << ".flush_done:\n";
+        o << "    ret\n";
+        if (in_id == 0) return o.str();
+
+        // 从输入缓冲区取一个字节到 eax；取完时先写出输出，再用一次 ReadFile 读满
+        o << "\nread_in:\n";
+        o << "    movq inpos(%rip), %rax\n";
+        o << "    cmpq inlen(%rip), %rax\n";
+        o << "    jae .read_refill\n";
+        o << ".read_next:\n";
+        o << "    leaq inbuf(%rip), %rdx\n";
+        o << "    movzbl (%rdx,%rax), %eax\n";
+        o << "    incq inpos(%rip)\n";
+        o << "    ret\n";
+        o << ".read_refill:\n";
+        o << "    pushq %rcx\n";
+        o << "    call flush_out\n";
+        o << "    subq $48, %rsp\n";
+        o << "    movq %r13, %rcx\n";
+        o << "    leaq inbuf(%rip), %rdx\n";
+        o << "    movq $" << opts.in_buffer << ", %r8\n";
+        o << "    leaq readcnt(%rip), %r9\n";
+        o << "    movq $0, 32(%rsp)\n";
+        o << "    call ReadFile\n";
+        o << "    addq $48, %rsp\n";
+        o << "    popq %rcx\n";
+        o << "    movl readcnt(%rip), %eax\n";
+        o << "    testq %rax, %rax\n";
+        o << "    jz .read_eof\n";
+        o << "    movq %rax, inlen(%rip)\n";
+        o << "    xorl %eax, %eax\n";
+        o << "    movq %rax, inpos(%rip)\n";
+        o << "    jmp .read_next\n";
+        o << ".read_eof:\n";
+        o << (opts.eof == EofMode::Zero ? "    xorl %eax, %eax\n" : "    movl $-1, %eax\n");
+        o << "    ret\n";
         return o.str();
     }
 
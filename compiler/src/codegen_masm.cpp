@@ -1,13 +1,56 @@
 #include "codegen.h"
+#include "bf/optimizer.h"
+#include "cell_cache.h"
 #include <sstream>
 
 namespace bf {
 
+// [rbx+offset] 形式的内存操作数
+static std::string mem(int offset) {
+    if (offset == 0) return "[rbx]";
+    return "[rbx" + std::string(offset > 0 ? "+" : "") + std::to_string(offset) + "]";
+}
+
+// ScanZero 的 SSE2 候选字节掩码：步长 ±1/±2/±4 返回 pmovmskb 结果上的掩码，其余返回 0
+static int scan_mask(int stride) {
+    switch (stride) {
+        case 1: case -1: return 0xFFFF;
+        case 2:  return 0x5555;
+        case 4:  return 0x1111;
+        case -2: return 0xAAAA;
+        case -4: return 0x8888;
+    }
+    return 0;
+}
+
 class MasmCodeGen : public CodeGenerator {
 public:
-    std::string generate(const std::vector<IRInst>& program) override {
+    std::string generate(const std::vector<IRInst>& program,
+                         const CodegenOptions& opts) override {
         std::ostringstream o;
         int label_id = 0;
+        int scan_id = 0;
+        int out_id = 0;
+        int in_id = 0;
+        // 单元格宽度：访存用 byte/word/dword ptr，缓存寄存器为 cl/cx/ecx，偏移和指针移动按字节数缩放
+        const int cb = static_cast<int>(opts.cell_bytes());
+        const uint32_t cmask = cell_mask(opts.cell_bits);
+        const char* sz = cb == 1 ? "byte ptr" : cb == 2 ? "word ptr" : "dword ptr";
+        const char* creg = cb == 1 ? "cl" : cb == 2 ? "cx" : "ecx";
+        const char* areg = cb == 1 ? "al" : cb == 2 ? "ax" : "eax";
+        auto cell = [&](int offset) { return std::string(sz) + " " + mem(offset * cb); };
+        // 零扩展读取 [rbx+offset]（dword 单元格直接 mov）
+        auto load_zx = [&](const char* reg, int offset = 0) {
+            return (cb == 4 ? std::string("mov ") : std::string("movzx ")) + reg + ", " + cell(offset);
+        };
+        // 当前单元格缓存在 cl 中，见 cell_cache.h
+        CellCache cache(opts.cache_cell);
+        auto load_cell = [&]() {
+            if (cache.need_load()) o << "    " << load_zx("ecx") << "\n";
+        };
+        auto spill_cell = [&]() {
+            if (cache.need_store_and_invalidate()) o << "    mov " << sz << " [rbx], " << creg << "\n";
+        };
 
         o << "; BF Compiler output - MASM x86-64 for Windows\n";
         o << "extrn GetStdHandle : proc\n";
@@ -15,14 +58,23 @@ public:
         o << "extrn ReadFile : proc\n";
         o << "extrn ExitProcess : proc\n\n";
         o << ".data\n";
-        o << "tape    db 30000 dup(0)\n";
+        o << "        db " << TAPE_MARGIN * cb << " dup(0)    ; tape 前后的边距\n";
+        o << "tape    db " << TAPE_SIZE * cb << " dup(0)\n";
+        o << "        db " << TAPE_MARGIN * cb << " dup(0)\n";
         o << "written dq 0\n";
-        o << "readcnt dq 0\n\n";
+        o << "readcnt dq 0\n";
+        o << "outbuf  db " << opts.out_buffer << " dup(0)\n";
+        o << "inpos   dq 0\n";
+        o << "inlen   dq 0\n";
+        o << "inbuf   db " << opts.in_buffer << " dup(0)\n\n";
         o << ".code\n";
         o << "main proc\n";
         o << "    push rbx\n";
         o << "    sub rsp, 48\n";
-        o << "    lea rbx, tape\n\n";
+        o << "    lea rbx, tape\n";
+        // 输出缓冲：r15 = 缓冲区基址，r14 = 已缓冲字节数
+        o << "    lea r15, outbuf\n";
+        o << "    xor r14d, r14d\n\n";
 
         // 获取stdout和stdin句柄
         o << "    mov ecx, -11\n";
@@ -36,51 +88,164 @@ public:
             const auto& inst = program[i];
             switch (inst.type) {
                 case IRType::MovePtr:
+                    spill_cell();
                     if (inst.operand > 0)
-                        o << "    add rbx, " << inst.operand << "\n";
+                        o << "    add rbx, " << inst.operand * cb << "\n";
                     else
-                        o << "    sub rbx, " << -inst.operand << "\n";
+                        o << "    sub rbx, " << -inst.operand * cb << "\n";
                     break;
                 case IRType::AddVal:
+                    if (inst.offset == 0 && cache.enabled()) {
+                        load_cell();
+                        uint32_t v = static_cast<uint32_t>(inst.operand) & cmask;
+                        if (v == 1)
+                            o << "    inc " << creg << "\n";
+                        else if (v == cmask)
+                            o << "    dec " << creg << "\n";
+                        else
+                            o << "    add " << creg << ", " << v << "\n";
+                        cache.modified();
+                        break;
+                    }
                     if (inst.operand > 0)
-                        o << "    add byte ptr [rbx], " << inst.operand << "\n";
+                        o << "    add " << cell(inst.offset) << ", " << inst.operand << "\n";
                     else
-                        o << "    sub byte ptr [rbx], " << -inst.operand << "\n";
+                        o << "    sub " << cell(inst.offset) << ", " << -inst.operand << "\n";
                     break;
                 case IRType::SetZero:
-                    o << "    mov byte ptr [rbx], 0\n";
+                    if (inst.offset == 0 && cache.enabled()) {
+                        o << "    xor ecx, ecx\n";
+                        cache.modified();
+                        break;
+                    }
+                    o << "    mov " << cell(inst.offset) << ", 0\n";
                     break;
-                case IRType::Output:
+                case IRType::SetVal: {
+                    uint32_t v = static_cast<uint32_t>(inst.operand) & cmask;
+                    if (inst.offset == 0 && cache.enabled()) {
+                        o << "    mov " << creg << ", " << v << "\n";
+                        cache.modified();
+                        break;
+                    }
+                    o << "    mov " << cell(inst.offset) << ", " << v << "\n";
+                    break;
+                }
+                case IRType::MulAdd: {
+                    // [rbx+offset] += [rbx+src_offset] * factor
+                    int f = inst.operand < 0 ? -inst.operand : inst.operand;
+                    if (inst.src_offset == 0) load_cell();
+                    if (inst.src_offset == 0 && cache.cached())
+                        o << "    " << (cb == 4 ? "mov eax, ecx" : std::string("movzx eax, ") + creg) << "\n";
+                    else
+                        o << "    " << load_zx("eax", inst.src_offset) << "\n";
+                    if (f != 1)
+                        o << "    imul eax, eax, " << f << "\n";
+                    // 平衡循环内目标可能就是当前单元格
+                    if (inst.offset == 0 && cache.enabled()) {
+                        load_cell();
+                        o << "    " << (inst.operand > 0 ? "add " : "sub ") << creg << ", " << areg << "\n";
+                        cache.modified();
+                        break;
+                    }
+                    o << "    " << (inst.operand > 0 ? "add" : "sub")
+                      << " " << cell(inst.offset) << ", " << areg << "\n";
+                    break;
+                }
+                case IRType::ScanZero: {
+                    // 8 位单元格步长 ±1/±2/±4 用 SSE2 每次检查16字节，其余逐个检查
+                    spill_cell();
+                    int id = scan_id++;
+                    int s = inst.operand;
+                    int mask = cb == 1 ? scan_mask(s) : 0;
+                    o << "    ; ScanZero(" << s << ")\n";
+                    if (mask == 0) {
+                        o << "scan_" << id << ":\n";
+                        o << "    cmp " << sz << " [rbx], 0\n";
+                        o << "    je scan_done_" << id << "\n";
+                        o << "    " << (s > 0 ? "add" : "sub") << " rbx, " << (s > 0 ? s : -s) * cb << "\n";
+                        o << "    jmp scan_" << id << "\n";
+                        o << "scan_done_" << id << ":\n";
+                        break;
+                    }
+                    o << "    pxor xmm0, xmm0\n";
+                    o << "scan_" << id << ":\n";
+                    o << "    movdqu xmm1, xmmword ptr " << (s > 0 ? "[rbx]" : "[rbx-15]") << "\n";
+                    o << "    pcmpeqb xmm1, xmm0\n";
+                    o << "    pmovmskb eax, xmm1\n";
+                    if (mask == 0xFFFF)
+                        o << "    test eax, eax\n";
+                    else
+                        o << "    and eax, " << mask << "\n";
+                    o << "    jnz scan_found_" << id << "\n";
+                    o << "    " << (s > 0 ? "add" : "sub") << " rbx, 16\n";
+                    o << "    jmp scan_" << id << "\n";
+                    o << "scan_found_" << id << ":\n";
+                    if (s > 0) {
+                        o << "    bsf eax, eax\n";
+                        o << "    add rbx, rax\n";
+                    } else {
+                        o << "    bsr eax, eax\n";
+                        o << "    lea rbx, [rbx+rax-15]\n";
+                    }
+                    break;
+                }
+                case IRType::Output: {
+                    int id = out_id++;
                     o << "    ; Output\n";
-                    o << "    mov rcx, r12\n";
-                    o << "    mov rdx, rbx\n";
-                    o << "    mov r8, 1\n";
-                    o << "    lea r9, written\n";
-                    o << "    push 0\n";
-                    o << "    sub rsp, 32\n";
-                    o << "    call WriteFile\n";
-                    o << "    add rsp, 40\n";
+                    if (inst.offset == 0 && cache.cached()) {
+                        o << "    mov byte ptr [r15+r14], cl\n";
+                    } else {
+                        o << "    movzx eax, byte ptr " << mem(inst.offset * cb) << "\n";
+                        o << "    mov byte ptr [r15+r14], al\n";
+                    }
+                    o << "    inc r14\n";
+                    o << "    cmp r14, " << opts.out_buffer << "\n";
+                    o << "    jb out_" << id << "\n";
+                    o << "    call flush_out\n";
+                    o << "out_" << id << ":\n";
                     break;
-                case IRType::Input:
+                }
+                case IRType::Input: {
+                    // read_in 在 eax 中返回下一个字节；EOF 时返回 0 或 -1，保持不变模式下为 -1
+                    const bool keep = opts.eof == EofMode::Unchanged;
+                    const bool to_cl = inst.offset == 0 && cache.enabled();
+                    int id = in_id++;
                     o << "    ; Input\n";
-                    o << "    mov rcx, r13\n";
-                    o << "    mov rdx, rbx\n";
-                    o << "    mov r8, 1\n";
-                    o << "    lea r9, readcnt\n";
-                    o << "    push 0\n";
-                    o << "    sub rsp, 32\n";
-                    o << "    call ReadFile\n";
-                    o << "    add rsp, 40\n";
+                    if (!to_cl) spill_cell();
+                    else if (keep) load_cell();
+                    o << "    call read_in\n";
+                    if (keep) {
+                        o << "    test eax, eax\n";
+                        o << "    js in_" << id << "\n";
+                    }
+                    if (to_cl) {
+                        o << "    mov " << creg << ", " << areg << "\n";
+                        cache.modified();
+                    } else {
+                        o << "    mov " << cell(inst.offset) << ", " << areg << "\n";
+                    }
+                    if (keep) o << "in_" << id << ":\n";
                     break;
+                }
                 case IRType::LoopBegin:
+                    load_cell();
                     o << "loop_start_" << label_id << ":\n";
-                    o << "    cmp byte ptr [rbx], 0\n";
+                    if (cache.enabled() && inst.offset == 0)
+                        o << "    test " << creg << ", " << creg << "\n";
+                    else
+                        o << "    cmp " << cell(inst.offset) << ", 0\n";
+                    cache.loop_boundary();
                     o << "    je loop_end_" << label_id << "\n";
                     ++label_id;
                     break;
                 case IRType::LoopEnd: {
                     --label_id;
-                    o << "    cmp byte ptr [rbx], 0\n";
+                    load_cell();
+                    if (cache.enabled() && inst.offset == 0)
+                        o << "    test " << creg << ", " << creg << "\n";
+                    else
+                        o << "    cmp " << cell(inst.offset) << ", 0\n";
+                    cache.loop_boundary();
                     o << "    jne loop_start_" << label_id << "\n";
                     o << "loop_end_" << label_id << ":\n";
                     break;
@@ -88,8 +253,62 @@ public:
             }
         }
 
-        o << "\n    xor ecx, ecx\n";
-        o << "    call ExitProcess\n";
+        o << "\n    call flush_out\n";
+        o << "    xor ecx, ecx\n";
+        o << "    call ExitProcess\n\n";
+
+        // 写出 r14 字节的缓冲内容并清零计数
+        o << "flush_out:\n";
+        o << "    test r14, r14\n";
+        o << "    jz flush_done\n";
+        o << "    push rcx\n";
+        o << "    sub rsp, 8\n";
+        o << "    mov rcx, r12\n";
+        o << "    mov rdx, r15\n";
+        o << "    mov r8, r14\n";
+        o << "    lea r9, written\n";
+        o << "    push 0\n";
+        o << "    sub rsp, 32\n";
+        o << "    call WriteFile\n";
+        o << "    add rsp, 48\n";
+        o << "    pop rcx\n";
+        o << "    xor r14d, r14d\n";
+        o << "flush_done:\n";
+        o << "    ret\n";
+        if (in_id != 0) {
+            // 从输入缓冲区取一个字节到 eax；取完时先写出输出，再用一次 ReadFile 读满
+            o << "\nread_in:\n";
+            o << "    mov rax, inpos\n";
+            o << "    cmp rax, inlen\n";
+            o << "    jae read_refill\n";
+            o << "read_next:\n";
+            o << "    lea rdx, inbuf\n";
+            o << "    movzx eax, byte ptr [rdx+rax]\n";
+            o << "    inc inpos\n";
+            o << "    ret\n";
+            o << "read_refill:\n";
+            o << "    push rcx\n";
+            o << "    call flush_out\n";
+            o << "    sub rsp, 48\n";
+            o << "    mov rcx, r13\n";
+            o << "    lea rdx, inbuf\n";
+            o << "    mov r8, " << opts.in_buffer << "\n";
+            o << "    lea r9, readcnt\n";
+            o << "    mov qword ptr [rsp+32], 0\n";
+            o << "    call ReadFile\n";
+            o << "    add rsp, 48\n";
+            o << "    pop rcx\n";
+            o << "    mov eax, dword ptr readcnt\n";
+            o << "    test rax, rax\n";
+            o << "    jz read_eof\n";
+            o << "    mov inlen, rax\n";
+            o << "    xor eax, eax\n";
+            o << "    mov inpos, rax\n";
+            o << "    jmp read_next\n";
+            o << "read_eof:\n";
+            o << (opts.eof == EofMode::Zero ? "    xor eax, eax\n" : "    mov eax, -1\n");
+            o << "    ret\n";
+        }
         o << "main endp\n";
         o << "end\n";
         return o.str();
@@ -1,14 +1,57 @@
 #include "codegen.h"
+#include "bf/optimizer.h"
+#include "cell_cache.h"
 #include <sstream>
 #include <stack>
 
 namespace bf {
 
+// [rbx+offset] 形式的内存操作数
+static std::string mem(int offset) {
+    if (offset == 0) return "[rbx]";
+    return "[rbx" + std::string(offset > 0 ? "+" : "") + std::to_string(offset) + "]";
+}
+
+// ScanZero 的 SSE2 候选字节掩码：步长 ±1/±2/±4 返回 pmovmskb 结果上的掩码，其余返回 0
+static int scan_mask(int stride) {
+    switch (stride) {
+        case 1: case -1: return 0xFFFF;
+        case 2:  return 0x5555;
+        case 4:  return 0x1111;
+        case -2: return 0xAAAA;
+        case -4: return 0x8888;
+    }
+    return 0;
+}
+
 class NasmCodeGen : public CodeGenerator {
 public:
-    std::string generate(const std::vector<IRInst>& program) override {
+    std::string generate(const std::vector<IRInst>& program,
+                         const CodegenOptions& opts) override {
         std::ostringstream o;
         int label_id = 0;
+        int scan_id = 0;
+        int out_id = 0;
+        int in_id = 0;
+        // 单元格宽度：访存用 byte/word/dword，缓存寄存器为 cl/cx/ecx，偏移和指针移动按字节数缩放
+        const int cb = static_cast<int>(opts.cell_bytes());
+        const uint32_t cmask = cell_mask(opts.cell_bits);
+        const char* sz = cb == 1 ? "byte" : cb == 2 ? "word" : "dword";
+        const char* creg = cb == 1 ? "cl" : cb == 2 ? "cx" : "ecx";
+        const char* areg = cb == 1 ? "al" : cb == 2 ? "ax" : "eax";
+        auto cell = [&](int offset) { return std::string(sz) + " " + mem(offset * cb); };
+        // 零扩展读取 [rbx+offset]（dword 单元格直接 mov）
+        auto load_zx = [&](const char* reg, int offset = 0) {
+            return (cb == 4 ? std::string("mov ") : std::string("movzx ")) + reg + ", " + cell(offset);
+        };
+        // 当前单元格缓存在 cl 中，见 cell_cache.h
+        CellCache cache(opts.cache_cell);
+        auto load_cell = [&]() {
+            if (cache.need_load()) o << "    " << load_zx("ecx") << "\n";
+        };
+        auto spill_cell = [&]() {
+            if (cache.need_store_and_invalidate()) o << "    mov [rbx], " << creg << "\n";
+        };
         std::stack<int> label_stack;
 
         o << "; BF Compiler output - NASM x86-64 for Windows\n";
@@ -19,15 +62,24 @@ public:
         o << "extern ReadFile\n";
         o << "extern ExitProcess\n\n";
         o << "section .bss\n";
-        o << "tape:    resb 30000\n";
+        o << "         resb " << TAPE_MARGIN * cb << "     ; tape 前后的边距\n";
+        o << "tape:    resb " << TAPE_SIZE * cb << "\n";
+        o << "         resb " << TAPE_MARGIN * cb << "\n";
         o << "written: resq 1\n";
-        o << "readcnt: resq 1\n\n";
+        o << "readcnt: resq 1\n";
+        o << "outbuf:  resb " << opts.out_buffer << "\n";
+        o << "inpos:   resq 1\n";
+        o << "inlen:   resq 1\n";
+        o << "inbuf:   resb " << opts.in_buffer << "\n\n";
         o << "section .text\n";
         o << "global main\n";
         o << "main:\n";
         o << "    push rbx\n";
         o << "    sub rsp, 48\n";
-        o << "    lea rbx, [tape]\n\n";
+        o << "    lea rbx, [tape]\n";
+        // 输出缓冲：r15 = 缓冲区基址，r14 = 已缓冲字节数
+        o << "    lea r15, [outbuf]\n";
+        o << "    xor r14d, r14d\n\n";
 
         // 获取stdout和stdin句柄
         o << "    mov ecx, -11\n";
@@ -41,54 +93,167 @@ public:
             const auto& inst = program[i];
             switch (inst.type) {
                 case IRType::MovePtr:
+                    spill_cell();
                     if (inst.operand > 0)
-                        o << "    add rbx, " << inst.operand << "\n";
+                        o << "    add rbx, " << inst.operand * cb << "\n";
                     else
-                        o << "    sub rbx, " << -inst.operand << "\n";
+                        o << "    sub rbx, " << -inst.operand * cb << "\n";
                     break;
                 case IRType::AddVal:
+                    if (inst.offset == 0 && cache.enabled()) {
+                        load_cell();
+                        uint32_t v = static_cast<uint32_t>(inst.operand) & cmask;
+                        if (v == 1)
+                            o << "    inc " << creg << "\n";
+                        else if (v == cmask)
+                            o << "    dec " << creg << "\n";
+                        else
+                            o << "    add " << creg << ", " << v << "\n";
+                        cache.modified();
+                        break;
+                    }
                     if (inst.operand > 0)
-                        o << "    add byte [rbx], " << inst.operand << "\n";
+                        o << "    add " << cell(inst.offset) << ", " << inst.operand << "\n";
                     else
-                        o << "    sub byte [rbx], " << -inst.operand << "\n";
+                        o << "    sub " << cell(inst.offset) << ", " << -inst.operand << "\n";
                     break;
                 case IRType::SetZero:
-                    o << "    mov byte [rbx], 0\n";
+                    if (inst.offset == 0 && cache.enabled()) {
+                        o << "    xor ecx, ecx\n";
+                        cache.modified();
+                        break;
+                    }
+                    o << "    mov " << cell(inst.offset) << ", 0\n";
+                    break;
+                case IRType::SetVal: {
+                    uint32_t v = static_cast<uint32_t>(inst.operand) & cmask;
+                    if (inst.offset == 0 && cache.enabled()) {
+                        o << "    mov " << creg << ", " << v << "\n";
+                        cache.modified();
+                        break;
+                    }
+                    o << "    mov " << cell(inst.offset) << ", " << v << "\n";
+                    break;
+                }
+                case IRType::MulAdd: {
+                    // [rbx+offset] += [rbx+src_offset] * factor
+                    int f = inst.operand < 0 ? -inst.operand : inst.operand;
+                    if (inst.src_offset == 0) load_cell();
+                    if (inst.src_offset == 0 && cache.cached())
+                        o << "    " << (cb == 4 ? "mov eax, ecx" : std::string("movzx eax, ") + creg) << "\n";
+                    else
+                        o << "    " << load_zx("eax", inst.src_offset) << "\n";
+                    if (f != 1)
+                        o << "    imul eax, eax, " << f << "\n";
+                    // 平衡循环内目标可能就是当前单元格
+                    if (inst.offset == 0 && cache.enabled()) {
+                        load_cell();
+                        o << "    " << (inst.operand > 0 ? "add " : "sub ") << creg << ", " << areg << "\n";
+                        cache.modified();
+                        break;
+                    }
+                    o << "    " << (inst.operand > 0 ? "add" : "sub")
+                      << " " << cell(inst.offset) << ", " << areg << "\n";
+                    break;
+                }
+                case IRType::ScanZero: {
+                    // 8 位单元格步长 ±1/±2/±4 用 SSE2 每次检查16字节，其余逐个检查
+                    spill_cell();
+                    int id = scan_id++;
+                    int s = inst.operand;
+                    int mask = cb == 1 ? scan_mask(s) : 0;
+                    o << "    ; ScanZero(" << s << ")\n";
+                    if (mask == 0) {
+                        o << ".scan_" << id << ":\n";
+                        o << "    cmp " << sz << " [rbx], 0\n";
+                        o << "    je .scan_done_" << id << "\n";
+                        o << "    " << (s > 0 ? "add" : "sub") << " rbx, " << (s > 0 ? s : -s) * cb << "\n";
+                        o << "    jmp .scan_" << id << "\n";
+                        o << ".scan_done_" << id << ":\n";
+                        break;
+                    }
+                    o << "    pxor xmm0, xmm0\n";
+                    o << ".scan_" << id << ":\n";
+                    o << "    movdqu xmm1, " << (s > 0 ? "[rbx]" : "[rbx-15]") << "\n";
+                    o << "    pcmpeqb xmm1, xmm0\n";
+                    o << "    pmovmskb eax, xmm1\n";
+                    if (mask == 0xFFFF)
+                        o << "    test eax, eax\n";
+                    else
+                        o << "    and eax, " << mask << "\n";
+                    o << "    jnz .scan_found_" << id << "\n";
+                    o << "    " << (s > 0 ? "add" : "sub") << " rbx, 16\n";
+                    o << "    jmp .scan_" << id << "\n";
+                    o << ".scan_found_" << id << ":\n";
+                    if (s > 0) {
+                        o << "    bsf eax, eax\n";
+                        o << "    add rbx, rax\n";
+                    } else {
+                        o << "    bsr eax, eax\n";
+                        o << "    lea rbx, [rbx+rax-15]\n";
+                    }
                     break;
-                case IRType::Output:
+                }
+                case IRType::Output: {
+                    int id = out_id++;
                     o << "    ; Output\n";
-                    o << "    mov rcx, r12\n";
-                    o << "    mov rdx, rbx\n";
-                    o << "    mov r8, 1\n";
-                    o << "    lea r9, [written]\n";
-                    o << "    push 0\n";
-                    o << "    sub rsp, 32\n";
-                    o << "    call WriteFile\n";
-                    o << "    add rsp, 40\n";
+                    if (inst.offset == 0 && cache.cached()) {
+                        o << "    mov [r15+r14], cl\n";
+                    } else {
+                        o << "    movzx eax, byte " << mem(inst.offset * cb) << "\n";
+                        o << "    mov [r15+r14], al\n";
+                    }
+                    o << "    inc r14\n";
+                    o << "    cmp r14, " << opts.out_buffer << "\n";
+                    o << "    jb .out_" << id << "\n";
+                    o << "    call flush_out\n";
+                    o << ".out_" << id << ":\n";
                     break;
-                case IRType::Input:
+                }
+                case IRType::Input: {
+                    // read_in 在 eax 中返回下一个字节；EOF 时返回 0 或 -1，保持不变模式下为 -1
+                    const bool keep = opts.eof == EofMode::Unchanged;
+                    const bool to_cl = inst.offset == 0 && cache.enabled();
+                    int id = in_id++;
                     o << "    ; Input\n";
-                    o << "    mov rcx, r13\n";
-                    o << "    mov rdx, rbx\n";
-                    o << "    mov r8, 1\n";
-                    o << "    lea r9, [readcnt]\n";
-                    o << "    push 0\n";
-                    o << "    sub rsp, 32\n";
-                    o << "    call ReadFile\n";
-                    o << "    add rsp, 40\n";
+                    if (!to_cl) spill_cell();
+                    else if (keep) load_cell();
+                    o << "    call read_in\n";
+                    if (keep) {
+                        o << "    test eax, eax\n";
+                        o << "    js .in_" << id << "\n";
+                    }
+                    if (to_cl) {
+                        o << "    mov " << creg << ", " << areg << "\n";
+                        cache.modified();
+                    } else {
+                        o << "    mov " << cell(inst.offset) << ", " << areg << "\n";
+                    }
+                    if (keep) o << ".in_" << id << ":\n";
                     break;
+                }
                 case IRType::LoopBegin: {
                     int id = label_id++;
                     label_stack.push(id);
+                    load_cell();
                     o << ".loop_start_" << id << ":\n";
-                    o << "    cmp byte [rbx], 0\n";
+                    if (cache.enabled() && inst.offset == 0)
+                        o << "    test " << creg << ", " << creg << "\n";
+                    else
+                        o << "    cmp " << cell(inst.offset) << ", 0\n";
+                    cache.loop_boundary();
                     o << "    je .loop_end_" << id << "\n";
                     break;
                 }
                 case IRType::LoopEnd: {
                     int id = label_stack.top();
                     label_stack.pop();
-                    o << "    cmp byte [rbx], 0\n";
+                    load_cell();
+                    if (cache.enabled() && inst.offset == 0)
+                        o << "    test " << creg << ", " << creg << "\n";
+                    else
+                        o << "    cmp " << cell(inst.offset) << ", 0\n";
+                    cache.loop_boundary();
                     o << "    jne .loop_start_" << id << "\n";
                     o << ".loop_end_" << id << ":\n";
                     break;
@@ -96,8 +261,62 @@ public:
             }
         }
 
-        o << "\n    xor ecx, ecx\n";
-        o << "    call ExitProcess\n";
+        o << "\n    call flush_out\n";
+        o << "    xor ecx, ecx\n";
+        o << "    call ExitProcess\n\n";
+
+        // 写出 r14 字节的缓冲内容并清零计数
+        o << "flush_out:\n";
+        o << "    test r14, r14\n";
+        o << "    jz .done\n";
+        o << "    push rcx\n";
+        o << "    sub rsp, 8\n";
+        o << "    mov rcx, r12\n";
+        o << "    mov rdx, r15\n";
+        o << "    mov r8, r14\n";
+        o << "    lea r9, [written]\n";
+        o << "    push 0\n";
+        o << "    sub rsp, 32\n";
+        o << "    call WriteFile\n";
+        o << "    add rsp, 48\n";
+        o << "    pop rcx\n";
+        o << "    xor r14d, r14d\n";
+        o << ".done:\n";
+        o << "    ret\n";
+        if (in_id == 0) return o.str();
+
+        // 从输入缓冲区取一个字节到 eax；取完时先写出输出，再用一次 ReadFile 读满
+        o << "\nread_in:\n";
+        o << "    mov rax, [inpos]\n";
+        o << "    cmp rax, [inlen]\n";
+        o << "    jae .refill\n";
+        o << ".next:\n";
+        o << "    lea rdx, [inbuf]\n";
+        o << "    movzx eax, byte [rdx+rax]\n";
+        o << "    inc qword [inpos]\n";
+        o << "    ret\n";
+        o << ".refill:\n";
+        o << "    push rcx\n";
+        o << "    call flush_out\n";
+        o << "    sub rsp, 48\n";
+        o << "    mov rcx, r13\n";
+        o << "    lea rdx, [inbuf]\n";
+        o << "    mov r8, " << opts.in_buffer << "\n";
+        o << "    lea r9, [readcnt]\n";
+        o << "    mov qword [rsp+32], 0\n";
+        o << "    call ReadFile\n";
+        o << "    add rsp, 48\n";
+        o << "    pop rcx\n";
+        o << "    mov eax, [readcnt]\n";
+        o << "    test rax, rax\n";
+        o << "    jz .eof\n";
+        o << "    mov [inlen], rax\n";
+        o << "    xor eax, eax\n";
+        o << "    mov [inpos], rax\n";
+        o << "    jmp .next\n";
+        o << ".eof:\n";
+        o << (opts.eof == EofMode::Zero ? "    xor eax, eax\n" : "    mov eax, -1\n");
+        o << "    ret\n";
         return o.str();
     }
 
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+
+namespace bf {
+namespace elf {
+
+#pragma pack(push, 1)
+
+struct ELF_HEADER {
+    uint8_t  e_ident[16];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint64_t e_entry;
+    uint64_t e_phoff;
+    uint64_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+};
+
+struct PROGRAM_HEADER {
+    uint32_t p_type;
+    uint32_t p_flags;
+    uint64_t p_offset;
+    uint64_t p_vaddr;
+    uint64_t p_paddr;
+    uint64_t p_filesz;
+    uint64_t p_memsz;
+    uint64_t p_align;
+};
+
+#pragma pack(pop)
+
+constexpr uint16_t ET_EXEC   = 2;
+constexpr uint16_t EM_X86_64 = 62;
+constexpr uint32_t PT_LOAD   = 1;
+constexpr uint32_t PF_X = 1, PF_W = 2, PF_R = 4;
+
+} // namespace elf
+} // namespace bf
@@ -0,0 +1,103 @@
+#include "elf_writer.h"
+#include "elf_defs.h"
+#include "pe_defs.h"
+#include "pe_codegen.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <cstring>
+
+namespace bf {
+
+bool write_elf(const std::vector<IRInst>& program, const std::string& output_path,
+               const CodegenOptions& opts, const Snapshot& snap) {
+    const uint64_t IMAGE_BASE = 0x400000;
+    const uint32_t PAGE = 0x1000;
+    const uint32_t NUM_PHDRS = 2; // text (R+X), data (R+W)
+
+    // Layout: [ELF header][program headers][code] in one R+X segment
+    // mapped at IMAGE_BASE, followed by a page-aligned data segment. The data
+    // segment is zero-fill unless a snapshot provides its initial contents,
+    // which are then stored at the same page offset in the file. It ends with
+    // the growable tape (see CodeTarget), 2 * TAPE_RESERVE bytes of .bss that
+    // the kernel only commits as pages are touched.
+    uint32_t text_off = sizeof(elf::ELF_HEADER) + NUM_PHDRS * sizeof(elf::PROGRAM_HEADER);
+    text_off = pe::align_up(text_off, 16);
+
+    // Code size does not depend on the bss address (all RIP displacements are
+    // 32-bit), so generate once to measure, then again with the real layout.
+    auto target = pe::CodeTarget::linux_elf(text_off, text_off + PAGE * 16, opts);
+    target.resume_from(snap);
+    pe::CodeBuf dummy;
+    pe::gen_code(program, dummy, target);
+
+    uint32_t file_size = text_off + (uint32_t)dummy.size();
+    uint32_t bss_rva = pe::align_up(file_size, PAGE);
+    target.data_rva = bss_rva;
+    uint32_t bss_size = target.data_size();
+    std::vector<uint8_t> image = target.data_image(snap);
+
+    pe::CodeBuf code;
+    pe::gen_code(program, code, target);
+
+    elf::ELF_HEADER eh{};
+    eh.e_ident[0] = 0x7F; eh.e_ident[1] = 'E'; eh.e_ident[2] = 'L'; eh.e_ident[3] = 'F';
+    eh.e_ident[4] = 2; // ELFCLASS64
+    eh.e_ident[5] = 1; // ELFDATA2LSB
+    eh.e_ident[6] = 1; // EV_CURRENT
+    eh.e_type = elf::ET_EXEC;
+    eh.e_machine = elf::EM_X86_64;
+    eh.e_version = 1;
+    eh.e_entry = IMAGE_BASE + text_off;
+    eh.e_phoff = sizeof(elf::ELF_HEADER);
+    eh.e_ehsize = sizeof(elf::ELF_HEADER);
+    eh.e_phentsize = sizeof(elf::PROGRAM_HEADER);
+    eh.e_phnum = NUM_PHDRS;
+
+    elf::PROGRAM_HEADER ph[2]{};
+    // text: headers + code
+    ph[0].p_type = elf::PT_LOAD;
+    ph[0].p_flags = elf::PF_R | elf::PF_X;
+    ph[0].p_offset = 0;
+    ph[0].p_vaddr = ph[0].p_paddr = IMAGE_BASE;
+    ph[0].p_filesz = ph[0].p_memsz = text_off + code.size();
+    ph[0].p_align = PAGE;
+    // data: static output + tape image + output buffer + guard page + tape;
+    // the part past the snapshot image is zero-filled by the kernel
+    ph[1].p_type = elf::PT_LOAD;
+    ph[1].p_flags = elf::PF_R | elf::PF_W;
+    ph[1].p_offset = image.empty() ? 0 : bss_rva;
+    ph[1].p_vaddr = ph[1].p_paddr = IMAGE_BASE + bss_rva;
+    ph[1].p_filesz = image.size();
+    ph[1].p_memsz = bss_size;
+    ph[1].p_align = PAGE;
+
+    // --- Write file ---
+    std::ofstream out(output_path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Error: cannot create '" << output_path << "'\n";
+        return false;
+    }
+    out.write((const char*)&eh, sizeof(eh));
+    out.write((const char*)ph, sizeof(ph));
+    uint32_t hdr_written = sizeof(eh) + sizeof(ph);
+    std::vector<uint8_t> pad(text_off - hdr_written, 0);
+    out.write((const char*)pad.data(), pad.size());
+    out.write((const char*)code.data.data(), code.data.size());
+    if (!image.empty()) {
+        std::vector<uint8_t> gap(bss_rva - (text_off + code.size()), 0);
+        out.write((const char*)gap.data(), gap.size());
+        out.write((const char*)image.data(), image.size());
+    }
+    out.close();
+
+    // chmod +x
+    std::error_code ec;
+    std::filesystem::permissions(output_path,
+        std::filesystem::perms::owner_exec | std::filesystem::perms::group_exec |
+        std::filesystem::perms::others_exec,
+        std::filesystem::perm_options::add, ec);
+    return true;
+}
+
+} // namespace bf
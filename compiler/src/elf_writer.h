@@ -0,0 +1,16 @@
+#pragma once
+#include "bf/ir.h"
+#include "codegen.h"
+#include "bf/partial_eval.h"
+#include <string>
+#include <vector>
+
+namespace bf {
+
+// 直接将BF IR编译为 Linux x86-64 静态 ELF 可执行文件
+// 不依赖 libc，I/O 直接使用系统调用，tape 位于零填充的数据段
+// snap 非空时程序从部分求值的快照继续执行，快照作为数据段的文件内容写入
+bool write_elf(const std::vector<IRInst>& program, const std::string& output_path,
+               const CodegenOptions& opts = {}, const Snapshot& snap = {});
+
+} // namespace bf
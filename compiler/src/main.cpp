@@ -1,94 +1,282 @@
+#include "bf/batch.h"
+#include "bf/cache.h"
+#include "bf/frontend.h"
 #include "bf/lexer.h"
-#include "bf/parser.h"
 #include "bf/optimizer.h"
+#include "bf/partial_eval.h"
 #include "codegen.h"
 #include "pe_writer.h"
+#include "elf_writer.h"
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <sstream>
+#include <memory>
+#include <stdexcept>
 #include <string>
 
 static void print_usage() {
     std::cerr << "Usage:\n"
               << "  bf-compiler <input.bf> [-o output]           Generate PE executable\n"
+              << "  bf-compiler <input.bf> --target=linux        Generate static ELF64 executable\n"
               << "  bf-compiler <input.bf> --asm [-o output]     Generate assembly\n"
               << "  bf-compiler <input.bf> --asm --format=nasm   NASM format (default)\n"
               << "  bf-compiler <input.bf> --asm --format=masm   MASM format\n"
-              << "  bf-compiler <input.bf> --asm --format=att    AT&T/GAS format\n";
+              << "  bf-compiler <input.bf> --asm --format=att    AT&T/GAS format\n"
+              << "  bf-compiler --batch <inputs...> [-o dir]     Compile many files in parallel\n"
+              << "                   (inputs: files, directories of .bf files, @listfile)\n"
+              << "Options:\n"
+              << "  --out-buffer=N   Output buffer size in bytes (default 4096, 1 = unbuffered)\n"
+              << "  --in-buffer=N    Input buffer size in bytes, refilled by one read when used up\n"
+              << "                   (default 4096, 1 = one read per byte)\n"
+              << "  --eof=MODE       Cell value on end of input: unchanged (default), 0 or -1\n"
+              << "  --no-cell-cache  Keep every cell access in memory instead of caching [rbx] in cl\n"
+              << "  --no-peephole    Keep rel32 branches, loop-top tests and explicit compares\n"
+              << "                   (machine-code targets)\n"
+              << "  --cell-bits=N    Cell width: 8 (default), 16 or 32, wrapping modulo 2^N\n"
+              << "  --eval-steps=N   Run up to N steps before the first input at compile time\n"
+              << "                   and start from the result (default 10000000, 0 = off;\n"
+              << "                   executables only)\n"
+              << "  -j N, --jobs=N   Worker threads for --batch (default: hardware threads)\n"
+              << "  --cache          Reuse outputs from the compilation cache, keyed on the\n"
+              << "                   lexed tokens and these options ($XDG_CACHE_HOME/bfcompiler)\n"
+              << "  --cache-dir=D    Use D as the cache directory (implies --cache)\n";
+}
+
+// 一次运行中所有输入共用的编译设置
+struct Settings {
+    bool asm_mode = false;
+    bf::AsmFormat fmt = bf::AsmFormat::NASM;
+    bool linux_target = false;
+    bf::CodegenOptions opts;
+    uint64_t eval_steps = 10000000;
+};
+
+// 缓存键中的编译设置：影响输出内容的每个选项都必须出现在这里
+static std::string cache_config(const Settings& s) {
+    std::string config = "bf-compiler";
+    if (s.asm_mode) {
+        config += s.fmt == bf::AsmFormat::MASM ? " asm=masm"
+                : s.fmt == bf::AsmFormat::ATT  ? " asm=att" : " asm=nasm";
+    } else {
+        config += s.linux_target ? " target=linux" : " target=windows";
+        config += " eval_steps=" + std::to_string(s.eval_steps);
+        config += " peephole=" + std::to_string(s.opts.peephole);
+    }
+    config += " out_buffer=" + std::to_string(s.opts.out_buffer);
+    config += " in_buffer=" + std::to_string(s.opts.in_buffer);
+    config += " eof=" + std::to_string(static_cast<int>(s.opts.eof));
+    config += " cache_cell=" + std::to_string(s.opts.cache_cell);
+    config += " cell_bits=" + std::to_string(s.opts.cell_bits);
+    return config;
+}
+
+// 输入文件名替换扩展名后的默认输出路径
+static std::string default_output(const std::string& input_file, const Settings& s) {
+    std::string ext = s.asm_mode ? bf::create_codegen(s.fmt)->file_extension()
+                    : s.linux_target ? "" : ".exe";
+    auto dot = input_file.rfind('.');
+    if (dot == std::string::npos) return input_file + (s.linux_target ? ".elf" : ext);
+    return input_file.substr(0, dot) + ext;
+}
+
+// 编译一个文件并写出结果，cache 不为空时先查缓存，返回是否命中。
+// 各次调用之间不共享状态（代码缓冲区、.idata 等都在 write_pe/write_elf 内部各自构造），
+// 可以在多个线程上同时调用。出错时抛出 std::runtime_error
+static bool compile_file(const std::string& input_file, const std::string& output_file,
+                         const Settings& s, const bf::CompileCache* cache) {
+    bf::PackedProgram packed;
+    std::string key;
+    if (cache) {
+        std::string source = bf::read_file(input_file);
+        key = bf::CompileCache::key(bf::lex(source), cache_config(s));
+        if (cache->fetch(key, output_file)) return true;
+        packed = bf::parse_source(source.data(), source.size());
+    } else {
+        packed = bf::parse_file(input_file);
+    }
+    bf::optimize_in_place(packed, s.opts.cell_bits);
+    // 汇编输出的 tape 位于 .bss，不做部分求值
+    bf::Snapshot snap;
+    if (!s.asm_mode) snap = bf::partial_evaluate(packed, s.eval_steps, s.opts.cell_bits);
+    std::vector<bf::IRInst> program = bf::unpack(packed);
+
+    if (s.asm_mode) {
+        std::string code = bf::create_codegen(s.fmt)->generate(program, s.opts);
+        std::ofstream out(output_file);
+        if (!out) throw std::runtime_error("cannot write '" + output_file + "'");
+        out << code;
+    } else if (s.linux_target) {
+        if (!bf::write_elf(program, output_file, s.opts, snap))
+            throw std::runtime_error("failed to generate executable");
+    } else {
+        if (!bf::write_pe(program, output_file, s.opts, snap))
+            throw std::runtime_error("failed to generate executable");
+    }
+    if (cache) cache->store(key, output_file);
+    return false;
+}
+
+// --batch：在线程池上编译全部输入，逐个收集错误，全部结束后统一报告
+static int compile_batch(const std::vector<std::string>& args, const std::string& output_dir,
+                         unsigned jobs, const Settings& s, const bf::CompileCache* cache) {
+    std::vector<std::string> inputs;
+    try {
+        inputs = bf::expand_inputs(args);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    if (inputs.empty()) {
+        std::cerr << "Error: no input files\n";
+        return 1;
+    }
+    if (!output_dir.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(output_dir, ec);
+    }
+
+    auto output_of = [&](const std::string& input) {
+        std::string output = default_output(input, s);
+        if (!output_dir.empty()) {
+            output = (std::filesystem::path(output_dir) /
+                      std::filesystem::path(output).filename()).string();
+        }
+        return output;
+    };
+
+    // -o 目录只保留文件名，不同目录下的同名输入会写到同一个输出，先挑出来报错
+    const size_t total = inputs.size();
+    auto errors = bf::take_output_conflicts(inputs, output_of);
+
+    std::atomic<size_t> hits{0};
+    auto failed = bf::run_batch(inputs, jobs, [&](const std::string& input) {
+        if (compile_file(input, output_of(input), s, cache)) ++hits;
+    });
+    errors.insert(errors.end(), failed.begin(), failed.end());
+
+    for (const auto& e : errors) {
+        std::cerr << "Error: " << e.input << ": " << e.message << "\n";
+    }
+    std::cout << "Compiled " << total - errors.size() << " of " << total << " files";
+    if (!errors.empty()) std::cout << " (" << errors.size() << " failed)";
+    if (cache) std::cout << ", " << hits << " from cache";
+    std::cout << "\n";
+    return errors.empty() ? 0 : 1;
 }
 
 int main(int argc, char* argv[]) {
     if (argc < 2) { print_usage(); return 1; }
 
-    std::string input_file;
+    std::vector<std::string> inputs;
     std::string output_file;
-    bool asm_mode = false;
-    bf::AsmFormat fmt = bf::AsmFormat::NASM;
+    Settings s;
+    bool batch = false;
+    unsigned jobs = 0;
+    bool use_cache = false;
+    std::string cache_dir;
 
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if (arg == "--asm") {
-            asm_mode = true;
+            s.asm_mode = true;
         } else if (arg.rfind("--format=", 0) == 0) {
             std::string f = arg.substr(9);
-            if (f == "masm") fmt = bf::AsmFormat::MASM;
-            else if (f == "nasm") fmt = bf::AsmFormat::NASM;
-            else if (f == "att" || f == "gas") fmt = bf::AsmFormat::ATT;
+            if (f == "masm") s.fmt = bf::AsmFormat::MASM;
+            else if (f == "nasm") s.fmt = bf::AsmFormat::NASM;
+            else if (f == "att" || f == "gas") s.fmt = bf::AsmFormat::ATT;
             else { std::cerr << "Unknown format: " << f << "\n"; return 1; }
+        } else if (arg.rfind("--target=", 0) == 0) {
+            std::string t = arg.substr(9);
+            if (t == "linux") s.linux_target = true;
+            else if (t == "windows") s.linux_target = false;
+            else { std::cerr << "Unknown target: " << t << "\n"; return 1; }
+        } else if (arg.rfind("--out-buffer=", 0) == 0) {
+            long n = std::strtol(arg.c_str() + 13, nullptr, 10);
+            if (n < 1 || n > (1 << 24)) {
+                std::cerr << "Invalid output buffer size: " << arg.substr(13) << "\n";
+                return 1;
+            }
+            s.opts.out_buffer = static_cast<uint32_t>(n);
+        } else if (arg.rfind("--in-buffer=", 0) == 0) {
+            long n = std::strtol(arg.c_str() + 12, nullptr, 10);
+            if (n < 1 || n > (1 << 24)) {
+                std::cerr << "Invalid input buffer size: " << arg.substr(12) << "\n";
+                return 1;
+            }
+            s.opts.in_buffer = static_cast<uint32_t>(n);
+        } else if (arg.rfind("--eof=", 0) == 0) {
+            if (!bf::parse_eof_mode(arg.substr(6), s.opts.eof)) {
+                std::cerr << "Invalid EOF mode: " << arg.substr(6) << "\n";
+                return 1;
+            }
+        } else if (arg == "--no-cell-cache") {
+            s.opts.cache_cell = false;
+        } else if (arg == "--no-peephole") {
+            s.opts.peephole = false;
+        } else if (arg.rfind("--cell-bits=", 0) == 0) {
+            int n = std::atoi(arg.c_str() + 12);
+            if (!bf::valid_cell_bits(n)) {
+                std::cerr << "Invalid cell width: " << arg.substr(12) << "\n";
+                return 1;
+            }
+            s.opts.cell_bits = n;
+        } else if (arg.rfind("--eval-steps=", 0) == 0) {
+            char* end = nullptr;
+            s.eval_steps = std::strtoull(arg.c_str() + 13, &end, 10);
+            if (end == arg.c_str() + 13 || *end != '\0') {
+                std::cerr << "Invalid step budget: " << arg.substr(13) << "\n";
+                return 1;
+            }
+        } else if (arg == "--batch") {
+            batch = true;
+        } else if ((arg == "-j" && i + 1 < argc) || arg.rfind("--jobs=", 0) == 0) {
+            std::string v = arg == "-j" ? argv[++i] : arg.substr(7);
+            long n = std::strtol(v.c_str(), nullptr, 10);
+            if (n < 1 || n > 1024) {
+                std::cerr << "Invalid job count: " << v << "\n";
+                return 1;
+            }
+            jobs = static_cast<unsigned>(n);
+        } else if (arg == "--cache") {
+            use_cache = true;
+        } else if (arg.rfind("--cache-dir=", 0) == 0) {
+            use_cache = true;
+            cache_dir = arg.substr(12);
         } else if (arg == "-o" && i + 1 < argc) {
             output_file = argv[++i];
         } else if (arg[0] != '-') {
-            input_file = arg;
+            inputs.push_back(arg);
         }
     }
 
-    if (input_file.empty()) { print_usage(); return 1; }
-
-    std::ifstream file(input_file);
-    if (!file) {
-        std::cerr << "Error: cannot open '" << input_file << "'\n";
+    if (inputs.empty()) { print_usage(); return 1; }
+    if (inputs.size() > 1 && !batch) {
+        std::cerr << "Error: multiple input files given; use --batch to process them all\n";
+        return 1;
+    }
+    if (s.asm_mode && s.linux_target) {
+        std::cerr << "Error: assembly output only supports the Windows target\n";
         return 1;
     }
 
-    std::ostringstream ss;
-    ss << file.rdbuf();
-    auto tokens = bf::lex(ss.str());
-    auto program = bf::parse(tokens);
-    program = bf::optimize(program);
-
-    if (asm_mode) {
-        auto gen = bf::create_codegen(fmt);
-        std::string code = gen->generate(program);
-
-        if (output_file.empty()) {
-            auto dot = input_file.rfind('.');
-            output_file = (dot != std::string::npos)
-                ? input_file.substr(0, dot) + gen->file_extension()
-                : input_file + gen->file_extension();
-        }
+    std::unique_ptr<bf::CompileCache> cache;
+    if (use_cache) cache = std::make_unique<bf::CompileCache>(cache_dir);
 
-        std::ofstream out(output_file);
-        if (!out) {
-            std::cerr << "Error: cannot write '" << output_file << "'\n";
-            return 1;
-        }
-        out << code;
-        std::cout << "Assembly written to: " << output_file << "\n";
-    } else {
-        if (output_file.empty()) {
-            auto dot = input_file.rfind('.');
-            output_file = (dot != std::string::npos)
-                ? input_file.substr(0, dot) + ".exe"
-                : input_file + ".exe";
-        }
+    // 批量模式下 -o 指定输出目录
+    if (batch) return compile_batch(inputs, output_file, jobs, s, cache.get());
 
-        if (bf::write_pe(program, output_file)) {
-            std::cout << "Executable written to: " << output_file << "\n";
-        } else {
-            std::cerr << "Error: failed to generate executable\n";
-            return 1;
-        }
+    const std::string& input_file = inputs.front();
+    if (output_file.empty()) output_file = default_output(input_file, s);
+    bool hit = false;
+    try {
+        hit = compile_file(input_file, output_file, s, cache.get());
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
     }
-
+    std::cout << (s.asm_mode ? "Assembly written to: " : "Executable written to: ")
+              << output_file << (hit ? " (cached)" : "") << "\n";
     return 0;
 }
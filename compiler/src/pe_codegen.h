@@ -1,6 +1,11 @@
 #pragma once
 #include "pe_defs.h"
+#include "codegen.h"
+#include "cell_cache.h"
 #include "bf/ir.h"
+#include "bf/optimizer.h"
+#include "bf/partial_eval.h"
+#include <algorithm>
 #include <vector>
 #include <stack>
 
@@ -13,12 +18,231 @@ struct RipPatch {
     uint32_t target_rva; // absolute RVA of target
 };
 
-// Generate x86-64 machine code from BF IR
-// iat_rva: RVA of IAT (GetStdHandle, WriteFile, ReadFile, ExitProcess - 4 entries, 8 bytes each)
-// data_rva: RVA of .data section (tape[30000], written[8], readcnt[8])
-// text_rva: RVA of .text section
-inline void gen_code(const std::vector<IRInst>& prog, CodeBuf& c,
-                     uint32_t text_rva, uint32_t iat_rva, uint32_t data_rva) {
+// A position-dependent field in the emitted code. gen_code emits every
+// branch in its rel32 form and records it here; finish_layout() then picks
+// the final encoding and fills in all displacements.
+struct Fixup {
+    enum class Kind {
+        Rip,  // disp32 of a RIP-relative operand, the last field of its instruction
+        Call, // E8 rel32
+        Jcc,  // 0F 8x rel32, may become 7x rel8
+    };
+    Kind kind;
+    size_t at;       // offset of the 32-bit field in the unrelaxed code
+    uint32_t target; // Rip: absolute RVA; otherwise an offset in the unrelaxed code
+};
+
+// Multi-byte NOP of 1..7 bytes (Intel SDM recommended forms)
+inline void emit_nop(std::vector<uint8_t>& out, uint32_t n) {
+    static const uint8_t forms[7][7] = {
+        {0x90},
+        {0x66, 0x90},
+        {0x0F, 0x1F, 0x00},
+        {0x0F, 0x1F, 0x40, 0x00},
+        {0x0F, 0x1F, 0x44, 0x00, 0x00},
+        {0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00},
+        {0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00},
+    };
+    out.insert(out.end(), forms[n - 1], forms[n - 1] + n);
+}
+
+// Final layout of code emitted with rel32 branches.
+// With relax set, conditional branches start out as rel8 and are widened
+// back to rel32 while any displacement does not fit (iterative branch
+// relaxation; widening only grows the code, so this terminates). Each offset
+// in aligns is a hot loop head padded with NOPs to a 16-byte boundary when
+// that takes at most 7 bytes. text_rva is where the code is loaded; code
+// positions are assumed 16-byte aligned relative to it.
+inline void finish_layout(CodeBuf& c, const std::vector<Fixup>& fixups,
+                          const std::vector<size_t>& aligns, uint32_t text_rva, bool relax) {
+    constexpr uint32_t ALIGN = 16, MAX_SKIP = 7;
+
+    // Layout events in code order: a loop head to align, or a fixup. A Jcc
+    // event sits at the start of its instruction, the others at their field.
+    // A pad goes before an instruction starting at the same offset.
+    struct Event { size_t pos; bool align; size_t fixup; };
+    std::vector<Event> events;
+    for (size_t a : aligns) events.push_back({a, true, 0});
+    for (size_t k = 0; k < fixups.size(); ++k) {
+        const Fixup& f = fixups[k];
+        events.push_back({f.kind == Fixup::Kind::Jcc ? f.at - 2 : f.at, false, k});
+    }
+    std::sort(events.begin(), events.end(), [](const Event& x, const Event& y) {
+        return x.pos != y.pos ? x.pos < y.pos : x.align > y.align;
+    });
+
+    std::vector<char> is_short(fixups.size(), 0);
+    for (size_t k = 0; k < fixups.size(); ++k) is_short[k] = relax && fixups[k].kind == Fixup::Kind::Jcc;
+    std::vector<uint32_t> pad(events.size(), 0);
+    // delta_after[e]: total size change up to and including event e
+    std::vector<int64_t> delta_after(events.size(), 0);
+
+    auto compute = [&]() {
+        int64_t delta = 0;
+        for (size_t e = 0; e < events.size(); ++e) {
+            if (events[e].align) {
+                uint32_t at = (uint32_t)(events[e].pos + delta);
+                uint32_t n = (ALIGN - (text_rva + at) % ALIGN) % ALIGN;
+                pad[e] = n <= MAX_SKIP ? n : 0;
+                delta += pad[e];
+            } else if (is_short[events[e].fixup]) {
+                delta -= 4; // 6-byte jcc rel32 -> 2-byte jcc rel8
+            }
+            delta_after[e] = delta;
+        }
+    };
+    // New offset of an unrelaxed offset that is an instruction boundary.
+    // A jump to an aligned loop head lands after its padding.
+    auto map = [&](size_t pos) -> int64_t {
+        size_t lo = 0, hi = events.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            bool before = events[mid].align ? events[mid].pos <= pos : events[mid].pos < pos;
+            if (before) lo = mid + 1; else hi = mid;
+        }
+        return (int64_t)pos + (lo ? delta_after[lo - 1] : 0);
+    };
+
+    for (bool changed = true; changed;) {
+        changed = false;
+        compute();
+        for (size_t k = 0; k < fixups.size(); ++k) {
+            if (!is_short[k]) continue;
+            int64_t rel = map(fixups[k].target) - (map(fixups[k].at - 2) + 2);
+            if (rel < -128 || rel > 127) {
+                is_short[k] = 0;
+                changed = true;
+            }
+        }
+    }
+
+    // Emit the final code
+    std::vector<uint8_t> out;
+    out.reserve(c.size());
+    size_t src = 0;
+    for (size_t e = 0; e < events.size(); ++e) {
+        out.insert(out.end(), c.data.begin() + src, c.data.begin() + events[e].pos);
+        src = events[e].pos;
+        if (events[e].align) {
+            if (pad[e]) emit_nop(out, pad[e]);
+            continue;
+        }
+        const Fixup& f = fixups[events[e].fixup];
+        if (is_short[events[e].fixup]) {
+            int64_t rel = map(f.target) - ((int64_t)out.size() + 2);
+            out.push_back((uint8_t)(0x70 | (c.data[f.at - 1] & 0x0F))); // jcc rel8
+            out.push_back((uint8_t)rel);
+        } else {
+            out.insert(out.end(), c.data.begin() + src, c.data.begin() + f.at);
+            int64_t next_ip = (int64_t)out.size() + 4;
+            uint32_t v = f.kind == Fixup::Kind::Rip ? f.target - (uint32_t)(text_rva + next_ip)
+                                                    : (uint32_t)(map(f.target) - next_ip);
+            for (int i = 0; i < 4; ++i) out.push_back((uint8_t)(v >> (8 * i)));
+        }
+        src = f.at + 4;
+    }
+    out.insert(out.end(), c.data.begin() + src, c.data.end());
+    c.data.swap(out);
+}
+
+// Where the generated code runs: decides prologue, epilogue and I/O lowering.
+// The IR lowering in between is shared by every target.
+struct CodeTarget {
+    enum class Kind {
+        WindowsPE,  // process entry point, kernel32 calls through the IAT, tape in .data
+        LinuxJit,   // SysV function void(uint8_t* tape, uint8_t* outbuf, InputHeader* in), raw syscalls, returns
+        LinuxElf,   // static ELF entry point, growable tape in .bss, raw syscalls, exits via SYS_exit
+        LinuxJitLoop, // one loop for the tiered interpreter, see linux_jit_loop()
+    };
+    Kind kind = Kind::WindowsPE;
+    uint32_t text_rva = 0; // RVA of .text section
+    uint32_t iat_rva = 0;  // RVA of IAT (GetStdHandle, WriteFile, ReadFile, ExitProcess - 8 bytes each)
+    uint32_t data_rva = 0; // RVA of the data area, see data_size()
+    CodegenOptions opts;
+    uint32_t static_len = 0; // bytes of compile-time output written at startup
+    uint32_t tape_len = 0;   // bytes of snapshot tape up to its last non-zero byte
+    int32_t start_ptr = 0;   // initial data pointer (tape index)
+
+    static CodeTarget windows_pe(uint32_t text_rva, uint32_t iat_rva, uint32_t data_rva,
+                                 const CodegenOptions& opts) {
+        return {Kind::WindowsPE, text_rva, iat_rva, data_rva, opts};
+    }
+    static CodeTarget linux_jit(const CodegenOptions& opts) {
+        return {Kind::LinuxJit, 0, 0, 0, opts};
+    }
+    // SysV function {uint8_t* p; size_t pending} (uint8_t* p, uint8_t* outbuf, size_t pending,
+    // InputHeader* in) running a single LoopBegin..LoopEnd range: the data pointer
+    // and the number of bytes already in the caller's output buffer go in and come
+    // back out. The buffer is only flushed when full or before refilling the
+    // caller's input buffer, never on return. opts.in_buffer must be its capacity.
+    static CodeTarget linux_jit_loop(const CodegenOptions& opts) {
+        return {Kind::LinuxJitLoop, 0, 0, 0, opts};
+    }
+    static CodeTarget linux_elf(uint32_t text_rva, uint32_t bss_rva, const CodegenOptions& opts) {
+        return {Kind::LinuxElf, text_rva, 0, bss_rva, opts};
+    }
+
+    // Start from a partial-evaluation snapshot instead of an empty tape.
+    // The data area must then be initialized with data_image(snap).
+    void resume_from(const Snapshot& snap) {
+        static_len = (uint32_t)snap.output.size();
+        start_ptr = snap.pointer;
+        tape_len = (uint32_t)snap.tape.size();
+        while (tape_len > 0 && snap.tape[tape_len - 1] == 0) --tape_len;
+    }
+
+    // Data area layout (PE .data / ELF .bss; the JIT passes tape, outbuf and
+    // the input buffer in).
+    // PE: static[static_len, 16-aligned], margin, tape[TAPE_SIZE], margin,
+    //     written[8], readcnt[8], outbuf[out_buffer], input. Tape and margins
+    //     are in cells; input is an InputHeader, 8-aligned, and in_buffer bytes.
+    // ELF: static, tape image[tape_len, 16-aligned], written[8], readcnt[8],
+    //     outbuf, input, then from the next page: a guard page, TAPE_RESERVE bytes,
+    //     the tape origin and another TAPE_RESERVE bytes. The prologue makes
+    //     the guard page PROT_NONE and copies the tape image to the origin.
+    //     The kernel commits .bss pages on first touch and maps nothing past
+    //     the end, so running off either side faults instead of corrupting data.
+    static constexpr uint32_t GUARD_SIZE = 0x1000;
+    bool growable_tape() const { return kind == Kind::LinuxElf; }
+    uint32_t static_size() const { return align_up(static_len, 16); }
+    uint32_t margin_size() const { return TAPE_MARGIN * opts.cell_bytes(); }
+    uint32_t tape_size() const { return TAPE_SIZE * opts.cell_bytes(); }
+    uint32_t tape_image_offset() const {
+        return growable_tape() ? static_size() : static_size() + margin_size();
+    }
+    uint32_t written_offset() const {
+        return growable_tape() ? static_size() + align_up(tape_len, 16)
+                               : static_size() + margin_size() + tape_size() + margin_size();
+    }
+    uint32_t input_offset() const { return align_up(written_offset() + 16 + opts.out_buffer, 8); }
+    uint32_t io_end() const { return input_offset() + (uint32_t)sizeof(InputHeader) + opts.in_buffer; }
+    uint32_t guard_offset() const { return align_up(io_end(), GUARD_SIZE); }
+    uint32_t tape_offset() const {
+        return growable_tape() ? guard_offset() + GUARD_SIZE + TAPE_RESERVE : tape_image_offset();
+    }
+    uint32_t data_size() const {
+        return growable_tape() ? tape_offset() + TAPE_RESERVE : io_end();
+    }
+
+    // Initialized prefix of the data area for a snapshot: static output and
+    // the tape up to its last non-zero cell. The rest of the area is zero.
+    std::vector<uint8_t> data_image(const Snapshot& snap) const {
+        if (snap.output.empty() && tape_len == 0) return {};
+        std::vector<uint8_t> image(tape_len ? tape_image_offset() + tape_len : static_size(), 0);
+        std::copy(snap.output.begin(), snap.output.end(), image.begin());
+        std::copy(snap.tape.begin(), snap.tape.begin() + tape_len,
+                  image.begin() + tape_image_offset());
+        return image;
+    }
+};
+
+// Generate x86-64 machine code from BF IR for the given target
+inline void gen_code(const std::vector<IRInst>& prog, CodeBuf& c, const CodeTarget& t) {
+    const bool win = t.kind == CodeTarget::Kind::WindowsPE;
+    uint32_t text_rva = t.text_rva;
+    uint32_t iat_rva = t.iat_rva;
+    uint32_t data_rva = t.data_rva;
+
     // IAT layout: [GetStdHandle][WriteFile][ReadFile][ExitProcess] each 8 bytes
     uint32_t iat_GetStdHandle = iat_rva;
     uint32_t iat_WriteFile    = iat_rva + 8;
@@ -26,137 +250,571 @@ inline void gen_code(const std::vector<IRInst>& prog, CodeBuf& c,
     uint32_t iat_ExitProcess  = iat_rva + 24;
 
     // Data layout
-    uint32_t d_tape    = data_rva;
-    uint32_t d_written = data_rva + 30000;
-    uint32_t d_readcnt = data_rva + 30008;
+    uint32_t d_static  = data_rva;
+    uint32_t d_image   = data_rva + t.tape_image_offset();
+    uint32_t d_tape    = data_rva + t.tape_offset();
+    uint32_t d_written = data_rva + t.written_offset();
+    uint32_t d_readcnt = d_written + 8;
+    uint32_t d_outbuf  = d_readcnt + 8;
+    uint32_t d_input   = data_rva + t.input_offset();
+    uint32_t d_inbuf   = d_input + (uint32_t)sizeof(InputHeader);
+    uint32_t d_guard   = data_rva + t.guard_offset();
+
+    // Position-dependent fields, resolved by finish_layout() at the end
+    std::vector<Fixup> fixups;
+    std::vector<size_t> aligns;
+    const bool peephole = t.opts.peephole;
 
     // Helper: emit RIP-relative 32-bit displacement
     // RIP-relative addressing: disp = target_rva - (text_rva + code_offset_after_instr)
     auto rip_rel = [&](uint32_t target) {
-        uint32_t next_ip_rva = text_rva + (uint32_t)c.size() + 4;
-        uint32_t disp = target - next_ip_rva;
-        c.u32(disp);
+        fixups.push_back({Fixup::Kind::Rip, c.size(), target});
+        c.u32(0);
+    };
+
+    // Cell width. Byte cells use the 8-bit opcode of each pair (FE/FF, 80/81,
+    // C6/C7, 88/89, 00/01, 28/29, 84/85); word cells use the full-size opcode
+    // with a 0x66 prefix, dword cells the full-size opcode alone. IR offsets,
+    // pointer moves and the tape start are in cells and scaled by cb.
+    const uint32_t cb = t.opts.cell_bytes();
+    const uint32_t cmask = cell_mask(t.opts.cell_bits);
+    auto op_sized = [&](uint8_t byte_op) {
+        if (cb == 2) c.u8(0x66);
+        c.u8(cb == 1 ? byte_op : (uint8_t)(byte_op + 1));
+    };
+    auto imm_cell = [&](uint32_t v) {
+        if (cb == 1) c.u8((uint8_t)v);
+        else if (cb == 2) c.u16((uint16_t)v);
+        else c.u32(v);
+    };
+    // movzx eax/ecx, cell [rbx] (mov for dword cells); modrm selects the operands
+    auto load_zx = [&](uint8_t modrm) {
+        if (cb == 4) { c.u8(0x8B); c.u8(modrm); return; }
+        c.u8(0x0F); c.u8(cb == 1 ? 0xB6 : 0xB7); c.u8(modrm);
+    };
+
+    // Helper: emit ModRM (+disp8/disp32) for a [rbx + disp] memory operand
+    auto mem_rbx = [&](uint8_t reg, int32_t disp) {
+        if (disp == 0) {
+            c.u8(0x03 | (reg << 3));
+        } else if (disp >= -128 && disp <= 127) {
+            c.u8(0x43 | (reg << 3)); c.u8((uint8_t)disp);
+        } else {
+            c.u8(0x83 | (reg << 3)); c.u32((uint32_t)disp);
+        }
+    };
+    // cmp cell [rbx+disp], 0
+    auto cmp_cell_zero = [&](int32_t disp) {
+        if (cb == 2) c.u8(0x66);
+        c.u8(cb == 1 ? 0x80 : 0x83); mem_rbx(7, disp); c.u8(0x00);
+    };
+
+    // Output buffering: r15 = outbuf base, r14 = bytes pending. Output stores
+    // into [r15+r14] and calls the flush routine (emitted after the epilogue)
+    // only when the buffer is full; exit and refilling the input buffer flush first.
+    if (t.kind == CodeTarget::Kind::LinuxJit) {
+        // Linux JIT prologue: save rbx/r12/r14/r15; rdi = tape, rsi = outbuf,
+        // rdx = input buffer, kept in r12 since the JIT has no data area.
+        // Only raw syscalls are made, so no stack frame is needed.
+        c.u8(0x53);                                  // push rbx
+        c.u8(0x41); c.u8(0x54);                      // push r12
+        c.u8(0x41); c.u8(0x56);                      // push r14
+        c.u8(0x41); c.u8(0x57);                      // push r15
+        c.u8(0x48); c.u8(0x89); c.u8(0xFB);          // mov rbx, rdi
+        c.u8(0x49); c.u8(0x89); c.u8(0xF7);          // mov r15, rsi
+        c.u8(0x49); c.u8(0x89); c.u8(0xD4);          // mov r12, rdx
+    } else if (t.kind == CodeTarget::Kind::LinuxJitLoop) {
+        // Same registers as LinuxJit, plus rdx = bytes already pending;
+        // the input buffer comes in rcx
+        c.u8(0x53);                                  // push rbx
+        c.u8(0x41); c.u8(0x54);                      // push r12
+        c.u8(0x41); c.u8(0x56);                      // push r14
+        c.u8(0x41); c.u8(0x57);                      // push r15
+        c.u8(0x48); c.u8(0x89); c.u8(0xFB);          // mov rbx, rdi
+        c.u8(0x49); c.u8(0x89); c.u8(0xF7);          // mov r15, rsi
+        c.u8(0x49); c.u8(0x89); c.u8(0xD6);          // mov r14, rdx
+        c.u8(0x49); c.u8(0x89); c.u8(0xCC);          // mov r12, rcx
+    } else if (t.kind == CodeTarget::Kind::LinuxElf) {
+        // mprotect(guard, GUARD_SIZE, PROT_NONE) below the growable tape
+        c.u8(0xB8); c.u32(10);                       // mov eax, 10 (SYS_mprotect)
+        c.u8(0x48); c.u8(0x8D); c.u8(0x3D); rip_rel(d_guard); // lea rdi, [rip + guard]
+        c.u8(0xBE); c.u32(CodeTarget::GUARD_SIZE);   // mov esi, GUARD_SIZE
+        c.u8(0x31); c.u8(0xD2);                      // xor edx, edx
+        c.u8(0x0F); c.u8(0x05);                      // syscall
+        if (t.tape_len != 0) {
+            // copy the snapshot tape from the file-backed image to the origin
+            c.u8(0x48); c.u8(0x8D); c.u8(0x35); rip_rel(d_image); // lea rsi, [rip + image]
+            c.u8(0x48); c.u8(0x8D); c.u8(0x3D); rip_rel(d_tape);  // lea rdi, [rip + tape]
+            c.u8(0xB9); c.u32(t.tape_len);           // mov ecx, tape_len
+            c.u8(0xF3); c.u8(0xA4);                  // rep movsb
+        }
+        // lea rbx, [rip + tape + start_ptr]
+        c.u8(0x48); c.u8(0x8D); c.u8(0x1D); rip_rel(d_tape + t.start_ptr * cb);
+        // lea r15, [rip + outbuf]
+        c.u8(0x4C); c.u8(0x8D); c.u8(0x3D); rip_rel(d_outbuf);
+    } else {
+        // Prologue: push rbx; push r12-r15; sub rsp, 48
+        // Stack alignment: entry RSP is 8-aligned (return addr pushed by call)
+        // 5 pushes = 40 bytes, sub 48 => total 8+40+48 = 96 (16-aligned)
+        c.u8(0x53);                         // push rbx
+        c.u8(0x41); c.u8(0x54);            // push r12
+        c.u8(0x41); c.u8(0x55);            // push r13
+        c.u8(0x41); c.u8(0x56);            // push r14
+        c.u8(0x41); c.u8(0x57);            // push r15
+        c.u8(0x48); c.u8(0x83); c.u8(0xEC); c.u8(0x30); // sub rsp, 48
+
+        // lea rbx, [rip + tape + start_ptr]
+        c.u8(0x48); c.u8(0x8D); c.u8(0x1D); rip_rel(d_tape + t.start_ptr * cb);
+        // lea r15, [rip + outbuf]
+        c.u8(0x4C); c.u8(0x8D); c.u8(0x3D); rip_rel(d_outbuf);
+
+        // mov ecx, -11 (STD_OUTPUT_HANDLE)
+        c.u8(0xB9); c.u32(0xFFFFFFF5);
+        // call [rip + GetStdHandle]
+        c.u8(0xFF); c.u8(0x15); rip_rel(iat_GetStdHandle);
+        // mov r12, rax
+        c.u8(0x49); c.u8(0x89); c.u8(0xC4);
+
+        // mov ecx, -10 (STD_INPUT_HANDLE)
+        c.u8(0xB9); c.u32(0xFFFFFFF6);
+        // call [rip + GetStdHandle]
+        c.u8(0xFF); c.u8(0x15); rip_rel(iat_GetStdHandle);
+        // mov r13, rax
+        c.u8(0x49); c.u8(0x89); c.u8(0xC5);
+    }
+    if (t.kind != CodeTarget::Kind::LinuxJitLoop) {
+        c.u8(0x45); c.u8(0x31); c.u8(0xF6);          // xor r14d, r14d
+    }
+
+    // call rel32 to the flush or input routine, resolved once they have been emitted
+    std::vector<size_t> flush_calls, read_calls;
+    auto call_flush = [&]() {
+        c.u8(0xE8);
+        flush_calls.push_back(fixups.size());
+        fixups.push_back({Fixup::Kind::Call, c.size(), 0});
+        c.u32(0);
+    };
+    auto call_read = [&]() {
+        c.u8(0xE8);
+        read_calls.push_back(fixups.size());
+        fixups.push_back({Fixup::Kind::Call, c.size(), 0});
+        c.u32(0);
     };
 
-    // Prologue: push rbx; push r12; push r13; sub rsp, 48
-    // Stack alignment: entry RSP is 8-aligned (return addr pushed by call)
-    // 3 pushes = 24 bytes, sub 48 => total 8+24+48 = 80 (16-aligned)
-    c.u8(0x53);                         // push rbx
-    c.u8(0x41); c.u8(0x54);            // push r12
-    c.u8(0x41); c.u8(0x55);            // push r13
-    c.u8(0x48); c.u8(0x83); c.u8(0xEC); c.u8(0x30); // sub rsp, 48
-
-    // lea rbx, [rip + tape]
-    c.u8(0x48); c.u8(0x8D); c.u8(0x1D); rip_rel(d_tape);
-
-    // mov ecx, -11 (STD_OUTPUT_HANDLE)
-    c.u8(0xB9); c.u32(0xFFFFFFF5);
-    // call [rip + GetStdHandle]
-    c.u8(0xFF); c.u8(0x15); rip_rel(iat_GetStdHandle);
-    // mov r12, rax
-    c.u8(0x49); c.u8(0x89); c.u8(0xC4);
-
-    // mov ecx, -10 (STD_INPUT_HANDLE)
-    c.u8(0xB9); c.u32(0xFFFFFFF6);
-    // call [rip + GetStdHandle]
-    c.u8(0xFF); c.u8(0x15); rip_rel(iat_GetStdHandle);
-    // mov r13, rax
-    c.u8(0x49); c.u8(0x89); c.u8(0xC5);
-
-    // Track instruction index -> code offset for jump resolution
+    // Output produced at compile time: point the flush routine at the static
+    // bytes once, then switch back to the real output buffer
+    if (t.static_len != 0) {
+        c.u8(0x4C); c.u8(0x8D); c.u8(0x3D); rip_rel(d_static);   // lea r15, [rip + static]
+        c.u8(0x41); c.u8(0xBE); c.u32(t.static_len);             // mov r14d, static_len
+        call_flush();
+        c.u8(0x4C); c.u8(0x8D); c.u8(0x3D); rip_rel(d_outbuf);   // lea r15, [rip + outbuf]
+    }
+
+    // Current cell cached in cl, see cell_cache.h
+    CellCache cache(t.opts.cache_cell);
+    auto load_cell = [&]() {
+        if (cache.need_load()) load_zx(0x0B);                            // movzx ecx, cell [rbx]
+    };
+    auto spill_cell = [&]() {
+        if (cache.need_store_and_invalidate()) { op_sized(0x88); c.u8(0x0B); } // mov [rbx], cl/cx/ecx
+    };
+
+    // Track instruction index -> code offset for jump resolution.
+    // For LoopBegin this is the loop head after any cache load, which is
+    // where the back edge jumps to without the peephole pass.
     std::vector<size_t> inst_offsets(prog.size());
-    // Forward jump patches: code_offset of jz displacement, target inst index
-    struct FwdPatch { size_t patch_off; size_t target_inst; };
+    // LoopBegin index -> offset just past its jz. With the peephole pass
+    // loops are rotated: the back edge jumps here, so each iteration runs
+    // a single test at the bottom instead of the LoopEnd and LoopBegin tests.
+    std::vector<size_t> body_offsets(prog.size());
+    // Forward jumps: fixup index of the jz, target inst index
+    struct FwdPatch { size_t fixup; size_t target_inst; };
     std::vector<FwdPatch> fwd_patches;
+    // ZF reflects cell [rbx+zf_offset]: the last instruction emitted was an
+    // inc/dec/add/sub of it, so a following loop test of that cell can be dropped
+    bool zf_valid = false;
+    int32_t zf_offset = 0;
 
     for (size_t i = 0; i < prog.size(); ++i) {
         inst_offsets[i] = c.size();
         const auto& inst = prog[i];
+        const int32_t off = inst.offset * (int32_t)cb; // byte displacement of the cell
+        const bool flags_from_cell = zf_valid && zf_offset == inst.offset;
+        zf_valid = peephole && inst.type == IRType::AddVal;
+        zf_offset = inst.offset;
         switch (inst.type) {
-        case IRType::MovePtr:
-            if (inst.operand == 1) {
+        case IRType::MovePtr: {
+            spill_cell();
+            int32_t n = inst.operand * (int32_t)cb;
+            if (n == 1) {
                 c.u8(0x48); c.u8(0xFF); c.u8(0xC3); // inc rbx
-            } else if (inst.operand == -1) {
+            } else if (n == -1) {
                 c.u8(0x48); c.u8(0xFF); c.u8(0xCB); // dec rbx
-            } else if (inst.operand > 0) {
-                c.u8(0x48); c.u8(0x81); c.u8(0xC3); c.u32(inst.operand);
+            } else if (n > 0) {
+                c.u8(0x48); c.u8(0x81); c.u8(0xC3); c.u32(n);
             } else {
-                c.u8(0x48); c.u8(0x81); c.u8(0xEB); c.u32(-inst.operand);
+                c.u8(0x48); c.u8(0x81); c.u8(0xEB); c.u32(-n);
             }
             break;
+        }
         case IRType::AddVal:
+            if (inst.offset == 0 && cache.enabled()) {
+                load_cell();
+                uint32_t v = (uint32_t)inst.operand & cmask;
+                if (v == 1)          { op_sized(0xFE); c.u8(0xC1); }              // inc cl
+                else if (v == cmask) { op_sized(0xFE); c.u8(0xC9); }              // dec cl
+                else                 { op_sized(0x80); c.u8(0xC1); imm_cell(v); } // add cl, imm
+                cache.modified();
+                break;
+            }
             if (inst.operand == 1) {
-                c.u8(0xFE); c.u8(0x03); // inc byte [rbx]
+                op_sized(0xFE); mem_rbx(0, off); // inc cell [rbx+off]
             } else if (inst.operand == -1) {
-                c.u8(0xFE); c.u8(0x0B); // dec byte [rbx]
+                op_sized(0xFE); mem_rbx(1, off); // dec cell [rbx+off]
             } else if (inst.operand > 0) {
-                c.u8(0x80); c.u8(0x03); c.u8((uint8_t)inst.operand);
+                op_sized(0x80); mem_rbx(0, off); imm_cell((uint32_t)inst.operand);
             } else {
-                c.u8(0x80); c.u8(0x2B); c.u8((uint8_t)(-inst.operand));
+                op_sized(0x80); mem_rbx(5, off); imm_cell(0u - (uint32_t)inst.operand);
             }
             break;
         case IRType::SetZero:
-            c.u8(0xC6); c.u8(0x03); c.u8(0x00); // mov byte [rbx], 0
+            if (inst.offset == 0 && cache.enabled()) {
+                c.u8(0x31); c.u8(0xC9);                 // xor ecx, ecx
+                cache.modified();
+                break;
+            }
+            op_sized(0xC6); mem_rbx(0, off); imm_cell(0); // mov cell [rbx+off], 0
+            break;
+        case IRType::SetVal:
+            if (inst.offset == 0 && cache.enabled()) {
+                // mov cl/cx/ecx, imm
+                if (cb == 2) c.u8(0x66);
+                c.u8(cb == 1 ? 0xB1 : 0xB9); imm_cell((uint32_t)inst.operand);
+                cache.modified();
+                break;
+            }
+            op_sized(0xC6); mem_rbx(0, off); imm_cell((uint32_t)inst.operand); // mov cell [rbx+off], imm
+            break;
+        case IRType::MulAdd: {
+            // The source is usually the current cell; inside balanced loops it
+            // is any cell at a fixed offset from rbx
+            if (inst.src_offset == 0) load_cell();
+            if (inst.src_offset == 0 && cache.cached()) {
+                if (cb == 4) { c.u8(0x89); c.u8(0xC8); } // mov eax, ecx
+                else load_zx(0xC1);                       // movzx eax, cl/cx
+            } else {
+                // movzx eax, cell [rbx+src]
+                if (cb == 4) c.u8(0x8B);
+                else { c.u8(0x0F); c.u8(cb == 1 ? 0xB6 : 0xB7); }
+                mem_rbx(0, inst.src_offset * (int32_t)cb);
+            }
+            int32_t f = inst.operand < 0 ? -inst.operand : inst.operand;
+            if (f != 1) {
+                if (f <= 127) {
+                    c.u8(0x6B); c.u8(0xC0); c.u8((uint8_t)f);  // imul eax, eax, imm8
+                } else {
+                    c.u8(0x69); c.u8(0xC0); c.u32((uint32_t)f); // imul eax, eax, imm32
+                }
+            }
+            // Inside balanced loops the target may be the current cell itself
+            if (inst.offset == 0 && cache.enabled()) {
+                load_cell();
+                op_sized(inst.operand > 0 ? 0x00 : 0x28); c.u8(0xC1); // add/sub cl/cx/ecx, al/ax/eax
+                cache.modified();
+                break;
+            }
+            // add/sub cell [rbx+offset], al/ax/eax
+            op_sized(inst.operand > 0 ? 0x00 : 0x28);
+            mem_rbx(0, off);
+            break;
+        }
+        case IRType::ScanZero: {
+            spill_cell();
+            int32_t s = inst.operand;
+            uint32_t mask = 0;
+            // The SIMD scan compares bytes, wider cells use the scalar loop
+            switch (cb == 1 ? s : 0) {
+                case 1: case -1: mask = 0xFFFF; break;
+                case 2:  mask = 0x5555; break;
+                case 4:  mask = 0x1111; break;
+                case -2: mask = 0xAAAA; break;
+                case -4: mask = 0x8888; break;
+            }
+            if (mask == 0) {
+                // scan: cmp cell [rbx], 0; jz done; add/sub rbx, |s| cells; jmp scan
+                size_t loop_off = c.size();
+                cmp_cell_zero(0);
+                c.u8(0x74); size_t jz_off = c.size(); c.u8(0);
+                int32_t n = (s > 0 ? s : -s) * (int32_t)cb;
+                if (n <= 127) {
+                    c.u8(0x48); c.u8(0x83); c.u8(s > 0 ? 0xC3 : 0xEB); c.u8((uint8_t)n);
+                } else {
+                    c.u8(0x48); c.u8(0x81); c.u8(s > 0 ? 0xC3 : 0xEB); c.u32((uint32_t)n);
+                }
+                c.u8(0xEB); c.u8((uint8_t)(loop_off - (c.size() + 1)));
+                c.data[jz_off] = (uint8_t)(c.size() - (jz_off + 1));
+                break;
+            }
+            // SSE2: test 16 bytes per iteration, keep only bytes on the stride.
+            // The loads may touch up to 15 bytes outside the tape, which stays
+            // within the TAPE_MARGIN every target reserves around it.
+            c.u8(0x66); c.u8(0x0F); c.u8(0xEF); c.u8(0xC0); // pxor xmm0, xmm0
+            size_t loop_off = c.size();
+            if (s > 0) {
+                c.u8(0xF3); c.u8(0x0F); c.u8(0x6F); c.u8(0x0B); // movdqu xmm1, [rbx]
+            } else {
+                c.u8(0xF3); c.u8(0x0F); c.u8(0x6F); c.u8(0x4B); c.u8(0xF1); // movdqu xmm1, [rbx-15]
+            }
+            c.u8(0x66); c.u8(0x0F); c.u8(0x74); c.u8(0xC8); // pcmpeqb xmm1, xmm0
+            c.u8(0x66); c.u8(0x0F); c.u8(0xD7); c.u8(0xC1); // pmovmskb eax, xmm1
+            if (mask == 0xFFFF) {
+                c.u8(0x85); c.u8(0xC0);                     // test eax, eax
+            } else {
+                c.u8(0x25); c.u32(mask);                    // and eax, mask
+            }
+            c.u8(0x75); c.u8(0x06);                         // jnz found
+            c.u8(0x48); c.u8(0x83); c.u8(s > 0 ? 0xC3 : 0xEB); c.u8(0x10); // add/sub rbx, 16
+            c.u8(0xEB); c.u8((uint8_t)(loop_off - (c.size() + 1)));         // jmp loop
+            if (s > 0) {
+                c.u8(0x0F); c.u8(0xBC); c.u8(0xC0);         // bsf eax, eax
+                c.u8(0x48); c.u8(0x01); c.u8(0xC3);         // add rbx, rax
+            } else {
+                c.u8(0x0F); c.u8(0xBD); c.u8(0xC0);         // bsr eax, eax
+                c.u8(0x48); c.u8(0x8D); c.u8(0x5C); c.u8(0x03); c.u8(0xF1); // lea rbx, [rbx+rax-15]
+            }
             break;
+        }
         case IRType::Output:
-            // mov rcx, r12
-            c.u8(0x4C); c.u8(0x89); c.u8(0xE1);
-            // mov rdx, rbx
-            c.u8(0x48); c.u8(0x89); c.u8(0xDA);
-            // mov r8d, 1
-            c.u8(0x41); c.u8(0xB8); c.u32(1);
-            // lea r9, [rip + written]
-            c.u8(0x4C); c.u8(0x8D); c.u8(0x0D); rip_rel(d_written);
-            // mov qword [rsp+32], 0
-            c.u8(0x48); c.u8(0xC7); c.u8(0x44); c.u8(0x24); c.u8(0x20);
-            c.u32(0);
-            // call [rip + WriteFile]
-            c.u8(0xFF); c.u8(0x15); rip_rel(iat_WriteFile);
+            if (inst.offset == 0 && cache.cached()) {
+                // mov [r15+r14], cl
+                c.u8(0x43); c.u8(0x88); c.u8(0x0C); c.u8(0x37);
+            } else {
+                // movzx eax, byte [rbx+off] (the low byte of the cell)
+                c.u8(0x0F); c.u8(0xB6); mem_rbx(0, off);
+                // mov [r15+r14], al
+                c.u8(0x43); c.u8(0x88); c.u8(0x04); c.u8(0x37);
+            }
+            // inc r14
+            c.u8(0x49); c.u8(0xFF); c.u8(0xC6);
+            // cmp r14, out_buffer
+            c.u8(0x49); c.u8(0x81); c.u8(0xFE); c.u32(t.opts.out_buffer);
+            // jb +5 (skip the flush call)
+            c.u8(0x72); c.u8(0x05);
+            call_flush();
             break;
-        case IRType::Input:
-            // mov rcx, r13
-            c.u8(0x4C); c.u8(0x89); c.u8(0xE9);
-            // mov rdx, rbx
-            c.u8(0x48); c.u8(0x89); c.u8(0xDA);
-            // mov r8d, 1
-            c.u8(0x41); c.u8(0xB8); c.u32(1);
-            // lea r9, [rip + readcnt]
-            c.u8(0x4C); c.u8(0x8D); c.u8(0x0D); rip_rel(d_readcnt);
-            // mov qword [rsp+32], 0
-            c.u8(0x48); c.u8(0xC7); c.u8(0x44); c.u8(0x24); c.u8(0x20);
-            c.u32(0);
-            // call [rip + ReadFile]
-            c.u8(0xFF); c.u8(0x15); rip_rel(iat_ReadFile);
+        case IRType::Input: {
+            // The input routine returns the next byte in eax, or the EOF value:
+            // 0 or -1 as configured, -1 (negative) when the cell stays unchanged
+            const bool keep = t.opts.eof == EofMode::Unchanged;
+            const bool to_cl = inst.offset == 0 && cache.enabled();
+            if (to_cl) {
+                if (keep) load_cell();
+            } else {
+                spill_cell();
+            }
+            call_read();
+            size_t js_off = 0;
+            if (keep) {
+                c.u8(0x85); c.u8(0xC0);                  // test eax, eax
+                c.u8(0x78); js_off = c.size(); c.u8(0);  // js done
+            }
+            if (to_cl) {
+                op_sized(0x88); c.u8(0xC1);              // mov cl/cx/ecx, al/ax/eax
+                cache.modified();
+            } else {
+                op_sized(0x88); mem_rbx(0, off);         // mov cell [rbx+off], al/ax/eax
+            }
+            if (keep) c.data[js_off] = (uint8_t)(c.size() - (js_off + 1));
             break;
-        case IRType::LoopBegin:
-            // cmp byte [rbx], 0
-            c.u8(0x80); c.u8(0x3B); c.u8(0x00);
+        }
+        case IRType::LoopBegin: {
+            // Loops inside a balanced loop test the cell at their offset; cl is
+            // still loaded so that every loop boundary has it valid
+            if (cache.enabled()) {
+                load_cell();
+                inst_offsets[i] = c.size();
+                if (flags_from_cell) {
+                    // ZF already set by the preceding add/sub
+                } else if (inst.offset == 0) {
+                    op_sized(0x84); c.u8(0xC9);         // test cl, cl
+                } else {
+                    cmp_cell_zero(off);                 // cmp cell [rbx+off], 0
+                }
+                cache.loop_boundary();
+            } else if (!flags_from_cell) {
+                cmp_cell_zero(off);                     // cmp cell [rbx+off], 0
+            }
             // jz <LoopEnd+1> (6 bytes: 0F 84 xx xx xx xx)
             c.u8(0x0F); c.u8(0x84);
-            fwd_patches.push_back({c.size(), (size_t)inst.jump_target});
+            fwd_patches.push_back({fixups.size(), (size_t)inst.jump_target});
+            fixups.push_back({Fixup::Kind::Jcc, c.size(), 0});
             c.u32(0); // placeholder
+            body_offsets[i] = c.size();
+            // Align the head of innermost loops, the hot ones
+            if (peephole) {
+                size_t j = i + 1;
+                while (prog[j].type != IRType::LoopBegin && prog[j].type != IRType::LoopEnd) ++j;
+                if (prog[j].type == IRType::LoopEnd) aligns.push_back(c.size());
+            }
             break;
+        }
         case IRType::LoopEnd: {
-            // cmp byte [rbx], 0
-            c.u8(0x80); c.u8(0x3B); c.u8(0x00);
-            // jnz <LoopBegin> (6 bytes: 0F 85 xx xx xx xx)
+            if (cache.enabled()) {
+                load_cell();
+                if (flags_from_cell) {
+                    // ZF already set by the preceding add/sub
+                } else if (inst.offset == 0) {
+                    op_sized(0x84); c.u8(0xC9);         // test cl, cl
+                } else {
+                    cmp_cell_zero(off);                 // cmp cell [rbx+off], 0
+                }
+                cache.loop_boundary();
+            } else if (!flags_from_cell) {
+                cmp_cell_zero(off);                     // cmp cell [rbx+off], 0
+            }
+            // jnz <loop body> (6 bytes: 0F 85 xx xx xx xx)
             c.u8(0x0F); c.u8(0x85);
-            size_t target_off = inst_offsets[inst.jump_target];
-            int32_t rel = (int32_t)target_off - (int32_t)(c.size() + 4);
-            c.u32((uint32_t)rel);
+            fixups.push_back({Fixup::Kind::Jcc, c.size(),
+                              (uint32_t)(peephole ? body_offsets[inst.jump_target]
+                                                  : inst_offsets[inst.jump_target])});
+            c.u32(0);
             break;
         }
         }
     }
 
-    // Epilogue: xor ecx,ecx; call [ExitProcess]
-    c.u8(0x33); c.u8(0xC9);
-    c.u8(0xFF); c.u8(0x15); rip_rel(iat_ExitProcess);
-
-    // Record end offset for forward jump patching
+    // Record epilogue offset for forward jump patching
     size_t epilogue_off = c.size();
+    if (t.kind == CodeTarget::Kind::LinuxJitLoop) {
+        // Hand the state back without flushing: the cell goes to memory,
+        // rax = data pointer, rdx = bytes pending
+        spill_cell();
+        c.u8(0x48); c.u8(0x89); c.u8(0xD8);          // mov rax, rbx
+        c.u8(0x4C); c.u8(0x89); c.u8(0xF2);          // mov rdx, r14
+        c.u8(0x41); c.u8(0x5F);                      // pop r15
+        c.u8(0x41); c.u8(0x5E);                      // pop r14
+        c.u8(0x41); c.u8(0x5C);                      // pop r12
+        c.u8(0x5B);                                  // pop rbx
+        c.u8(0xC3);                                  // ret
+    } else if (t.kind == CodeTarget::Kind::LinuxJit) {
+        call_flush();
+        c.u8(0x41); c.u8(0x5F);                      // pop r15
+        c.u8(0x41); c.u8(0x5E);                      // pop r14
+        c.u8(0x41); c.u8(0x5C);                      // pop r12
+        c.u8(0x5B);                                  // pop rbx
+        c.u8(0xC3);                                  // ret
+    } else if (t.kind == CodeTarget::Kind::LinuxElf) {
+        call_flush();
+        c.u8(0xB8); c.u32(60);                       // mov eax, 60 (SYS_exit)
+        c.u8(0x31); c.u8(0xFF);                      // xor edi, edi
+        c.u8(0x0F); c.u8(0x05);                      // syscall
+    } else {
+        // Epilogue: xor ecx,ecx; call [ExitProcess]
+        call_flush();
+        c.u8(0x33); c.u8(0xC9);
+        c.u8(0xFF); c.u8(0x15); rip_rel(iat_ExitProcess);
+    }
 
-    // Patch forward jumps (LoopBegin -> after LoopEnd)
+    // Flush routine: write r14 bytes from r15 if any are pending, reset r14.
+    // rcx is preserved because it may hold the cached current cell.
+    size_t flush_off = c.size();
+    c.u8(0x4D); c.u8(0x85); c.u8(0xF6);              // test r14, r14
+    c.u8(0x74); size_t jz_off = c.size(); c.u8(0);   // jz done
+    c.u8(0x51);                                      // push rcx
+    if (!win) {
+        c.u8(0xB8); c.u32(1);                        // mov eax, 1 (SYS_write)
+        c.u8(0xBF); c.u32(1);                        // mov edi, 1 (stdout)
+        c.u8(0x4C); c.u8(0x89); c.u8(0xFE);          // mov rsi, r15
+        c.u8(0x4C); c.u8(0x89); c.u8(0xF2);          // mov rdx, r14
+        c.u8(0x0F); c.u8(0x05);                      // syscall
+    } else {
+        // Entry RSP is 8 mod 16, push rcx + sub 48 realigns and leaves
+        // shadow space + arg 5
+        c.u8(0x48); c.u8(0x83); c.u8(0xEC); c.u8(0x30); // sub rsp, 48
+        c.u8(0x4C); c.u8(0x89); c.u8(0xE1);          // mov rcx, r12
+        c.u8(0x4C); c.u8(0x89); c.u8(0xFA);          // mov rdx, r15
+        c.u8(0x4D); c.u8(0x89); c.u8(0xF0);          // mov r8, r14
+        // lea r9, [rip + written]
+        c.u8(0x4C); c.u8(0x8D); c.u8(0x0D); rip_rel(d_written);
+        // mov qword [rsp+32], 0
+        c.u8(0x48); c.u8(0xC7); c.u8(0x44); c.u8(0x24); c.u8(0x20);
+        c.u32(0);
+        // call [rip + WriteFile]
+        c.u8(0xFF); c.u8(0x15); rip_rel(iat_WriteFile);
+        c.u8(0x48); c.u8(0x83); c.u8(0xC4); c.u8(0x30); // add rsp, 48
+    }
+    c.u8(0x59);                                      // pop rcx
+    c.u8(0x45); c.u8(0x31); c.u8(0xF6);              // xor r14d, r14d
+    c.data[jz_off] = (uint8_t)(c.size() - (jz_off + 1));
+    c.u8(0xC3);                                      // ret
+
+    // Input routine: eax = next byte of the input buffer. When it is used up,
+    // flush pending output, then refill it with one read of up to in_buffer
+    // bytes; nothing read means EOF. rcx is preserved like in the flush routine.
+    size_t read_off = c.size();
+    if (!read_calls.empty()) {
+        const bool jit = t.kind == CodeTarget::Kind::LinuxJit ||
+                         t.kind == CodeTarget::Kind::LinuxJitLoop;
+        auto input_base = [&]() {
+            if (jit) { c.u8(0x4C); c.u8(0x89); c.u8(0xE2); }        // mov rdx, r12
+            else { c.u8(0x48); c.u8(0x8D); c.u8(0x15); rip_rel(d_input); } // lea rdx, [rip + input]
+        };
+        input_base();
+        c.u8(0x48); c.u8(0x8B); c.u8(0x02);                 // mov rax, [rdx] (pos)
+        c.u8(0x48); c.u8(0x3B); c.u8(0x42); c.u8(0x08);     // cmp rax, [rdx+8] (len)
+        c.u8(0x73); size_t jae_off = c.size(); c.u8(0);     // jae refill
+        size_t next_off = c.size();
+        c.u8(0x0F); c.u8(0xB6); c.u8(0x44); c.u8(0x02); c.u8(0x10); // movzx eax, byte [rdx+rax+16]
+        c.u8(0x48); c.u8(0xFF); c.u8(0x02);                 // inc qword [rdx]
+        c.u8(0xC3);                                         // ret
+        c.data[jae_off] = (uint8_t)(c.size() - (jae_off + 1));
+        c.u8(0x51);                                         // push rcx
+        call_flush();
+        if (!win) {
+            c.u8(0x31); c.u8(0xC0);                         // xor eax, eax (SYS_read)
+            c.u8(0x31); c.u8(0xFF);                         // xor edi, edi (stdin)
+            if (jit) {
+                c.u8(0x49); c.u8(0x8D); c.u8(0x74); c.u8(0x24); c.u8(0x10); // lea rsi, [r12+16]
+            } else {
+                c.u8(0x48); c.u8(0x8D); c.u8(0x35); rip_rel(d_inbuf); // lea rsi, [rip + inbuf]
+            }
+            c.u8(0xBA); c.u32(t.opts.in_buffer);            // mov edx, in_buffer
+            c.u8(0x0F); c.u8(0x05);                         // syscall
+        } else {
+            // Entry RSP is 8 mod 16 and push rcx realigned it, so the flush
+            // call above and sub 48 (shadow space + arg 5) keep it aligned
+            c.u8(0x48); c.u8(0x83); c.u8(0xEC); c.u8(0x30); // sub rsp, 48
+            c.u8(0x4C); c.u8(0x89); c.u8(0xE9);             // mov rcx, r13
+            c.u8(0x48); c.u8(0x8D); c.u8(0x15); rip_rel(d_inbuf); // lea rdx, [rip + inbuf]
+            c.u8(0x41); c.u8(0xB8); c.u32(t.opts.in_buffer); // mov r8d, in_buffer
+            c.u8(0x4C); c.u8(0x8D); c.u8(0x0D); rip_rel(d_readcnt); // lea r9, [rip + readcnt]
+            c.u8(0x48); c.u8(0xC7); c.u8(0x44); c.u8(0x24); c.u8(0x20);
+            c.u32(0);                                       // mov qword [rsp+32], 0
+            c.u8(0xFF); c.u8(0x15); rip_rel(iat_ReadFile);  // call [rip + ReadFile]
+            c.u8(0x48); c.u8(0x83); c.u8(0xC4); c.u8(0x30); // add rsp, 48
+            c.u8(0x8B); c.u8(0x05); rip_rel(d_readcnt);     // mov eax, [rip + readcnt]
+        }
+        c.u8(0x59);                                         // pop rcx
+        input_base();
+        c.u8(0x48); c.u8(0x85); c.u8(0xC0);                 // test rax, rax
+        c.u8(0x7E); size_t jle_off = c.size(); c.u8(0);     // jle eof (error counts as EOF)
+        c.u8(0x48); c.u8(0x89); c.u8(0x42); c.u8(0x08);     // mov [rdx+8], rax
+        c.u8(0x31); c.u8(0xC0);                             // xor eax, eax
+        c.u8(0x48); c.u8(0x89); c.u8(0x02);                 // mov [rdx], rax
+        c.u8(0xEB); c.u8((uint8_t)(next_off - (c.size() + 1))); // jmp next
+        c.data[jle_off] = (uint8_t)(c.size() - (jle_off + 1));
+        if (t.opts.eof == EofMode::Zero) {
+            c.u8(0x31); c.u8(0xC0);                         // xor eax, eax
+        } else {
+            c.u8(0x83); c.u8(0xC8); c.u8(0xFF);             // or eax, -1
+        }
+        c.u8(0xC3);                                         // ret
+    }
+
+    for (size_t k : flush_calls) fixups[k].target = (uint32_t)flush_off;
+    for (size_t k : read_calls) fixups[k].target = (uint32_t)read_off;
+
+    // Forward jumps (LoopBegin -> after LoopEnd)
     for (auto& p : fwd_patches) {
         size_t target_inst = p.target_inst;
         size_t target_code;
@@ -164,9 +822,20 @@ inline void gen_code(const std::vector<IRInst>& prog, CodeBuf& c,
             target_code = inst_offsets[target_inst + 1];
         else
             target_code = epilogue_off;
-        int32_t rel = (int32_t)target_code - (int32_t)(p.patch_off + 4);
-        c.patch32(p.patch_off, (uint32_t)rel);
+        fixups[p.fixup].target = (uint32_t)target_code;
     }
+
+    finish_layout(c, fixups, aligns, text_rva, peephole);
+}
+
+// Windows PE entry point code
+// iat_rva: RVA of IAT (GetStdHandle, WriteFile, ReadFile, ExitProcess - 4 entries, 8 bytes each)
+// data_rva: RVA of .data section (see CodeTarget::data_size)
+// text_rva: RVA of .text section
+inline void gen_code(const std::vector<IRInst>& prog, CodeBuf& c,
+                     uint32_t text_rva, uint32_t iat_rva, uint32_t data_rva,
+                     const CodegenOptions& opts = {}) {
+    gen_code(prog, c, CodeTarget::windows_pe(text_rva, iat_rva, data_rva, opts));
 }
 
 } // namespace pe
@@ -7,7 +7,8 @@
 
 namespace bf {
 
-bool write_pe(const std::vector<IRInst>& program, const std::string& output_path) {
+bool write_pe(const std::vector<IRInst>& program, const std::string& output_path,
+              const CodegenOptions& opts, const Snapshot& snap) {
     const uint32_t FILE_ALIGN = 0x200;
     const uint32_t SECT_ALIGN = 0x1000;
     const uint64_t IMAGE_BASE = 0x0000000140000000ULL;
@@ -87,7 +88,9 @@ bool write_pe(const std::vector<IRInst>& program, const std::string& output_path
     uint32_t est_idata_rva = text_rva + SECT_ALIGN * 4; // generous estimate
     uint32_t est_data_rva  = est_idata_rva + SECT_ALIGN;
     uint32_t est_iat_rva   = est_idata_rva + iat_off;
-    pe::gen_code(program, dummy, text_rva, est_iat_rva, est_data_rva);
+    auto target = pe::CodeTarget::windows_pe(text_rva, est_iat_rva, est_data_rva, opts);
+    target.resume_from(snap);
+    pe::gen_code(program, dummy, target);
 
     // Now we know code size
     uint32_t code_size = (uint32_t)dummy.size();
@@ -101,12 +104,15 @@ bool write_pe(const std::vector<IRInst>& program, const std::string& output_path
     uint32_t idata_raw = pe::align_up(idata_vsize, FILE_ALIGN);
 
     data_rva = idata_rva + pe::align_up(idata_vsize, SECT_ALIGN);
-    uint32_t data_vsize = 30016; // tape(30000) + written(8) + readcnt(8)
+    // static output + margin + tape + margin + written(8) + readcnt(8) + outbuf
+    uint32_t data_vsize = target.data_size();
     uint32_t data_raw = pe::align_up(data_vsize, FILE_ALIGN);
 
     // Regenerate code with correct RVAs
+    target.iat_rva = iat_rva_real;
+    target.data_rva = data_rva;
     pe::CodeBuf code;
-    pe::gen_code(program, code, text_rva, iat_rva_real, data_rva);
+    pe::gen_code(program, code, target);
 
     // Fill ILT and IAT with RVAs to hint/name entries
     for (int i = 0; i < 4; ++i) {
@@ -224,8 +230,9 @@ bool write_pe(const std::vector<IRInst>& program, const std::string& output_path
         out.write((const char*)ip.data(), ip.size());
     }
 
-    // .data section
-    std::vector<uint8_t> data_sect(data_raw, 0);
+    // .data section: snapshot image (static output + tape), zero-filled after it
+    std::vector<uint8_t> data_sect = target.data_image(snap);
+    data_sect.resize(data_raw, 0);
     out.write((const char*)data_sect.data(), data_sect.size());
 
     out.close();
@@ -1,5 +1,7 @@
 #pragma once
 #include "bf/ir.h"
+#include "codegen.h"
+#include "bf/partial_eval.h"
 #include <string>
 #include <vector>
 
@@ -7,6 +9,8 @@ namespace bf {
 
 // 直接将BF IR编译为Windows x64 PE可执行文件
 // 不依赖任何外部汇编器或链接器
-bool write_pe(const std::vector<IRInst>& program, const std::string& output_path);
+// snap 非空时程序从部分求值的快照继续执行，快照写入 .data 节
+bool write_pe(const std::vector<IRInst>& program, const std::string& output_path,
+              const CodegenOptions& opts = {}, const Snapshot& snap = {});
 
 } // namespace bf
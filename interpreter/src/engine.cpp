@@ -0,0 +1,181 @@
+#include "engine.h"
+#include "bf/optimizer.h"
+#include <cstdio>
+
+namespace bf {
+
+enum class Mode {
+    Plain,    // 不统计
+    Counting, // 每条指令执行前 counts[ip] 加一，不融合
+    Stats,    // 统计执行的指令数和各操作码的分派次数
+};
+
+constexpr uint8_t opcode(IRType t) { return static_cast<uint8_t>(t); }
+constexpr uint8_t opcode(SuperOp s) { return static_cast<uint8_t>(s); }
+
+uint64_t DispatchStats::total_dispatches() const {
+    uint64_t total = 0;
+    for (uint64_t n : dispatches) total += n;
+    return total;
+}
+
+// Cell 为单元格类型，每种宽度各自实例化一份主循环，循环内没有宽度判断。
+// M 为 Plain 时统计代码在编译期去掉
+template <typename Cell, Mode M>
+static void run(const PackedProgram& program, const RunOptions& opts, uint64_t* counts,
+                DispatchStats* stats) {
+    Tape tape_buf(sizeof(Cell));
+    Cell* const tape = tape_buf.origin<Cell>();
+    const int lo = tape_buf.lo(), hi = tape_buf.hi();
+    int ptr = 0;
+    OutputBuffer out(opts.out_buffer);
+    InputBuffer in(opts.in_buffer, opts.eof);
+    std::vector<uint8_t> fused;
+    if (opts.fuse && M != Mode::Counting) fused = fuse_superinstructions(program.ops);
+    const uint8_t* ops = fused.empty() ? program.ops.data() : fused.data();
+    const int32_t* args = program.args.data();
+    const int32_t* offsets = program.offsets.data();
+    const int32_t* src_offsets = program.src_offsets.data();
+    int ip = 0;
+    int size = static_cast<int>(program.size());
+
+    // 超级指令的第二条也执行了
+    auto second = [&] {
+        if constexpr (M == Mode::Stats) ++stats->instructions;
+    };
+    auto add_val = [&](int i) { tape[ptr + offsets[i]] += static_cast<Cell>(args[i]); };
+    auto mul_add = [&](int i) {
+        tape[ptr + offsets[i]] += static_cast<Cell>(uint32_t{tape[ptr + src_offsets[i]]} *
+                                                    static_cast<uint32_t>(args[i]));
+    };
+
+    while (ip < size) {
+        const uint8_t op = ops[ip];
+        if constexpr (M == Mode::Counting) ++counts[ip];
+        if constexpr (M == Mode::Stats) {
+            ++stats->dispatches[op];
+            ++stats->instructions;
+        }
+        switch (op) {
+            case opcode(IRType::MovePtr):
+                ptr += args[ip];
+                break;
+            case opcode(IRType::AddVal):
+                add_val(ip);
+                break;
+            case opcode(IRType::Output):
+                out.put(static_cast<uint8_t>(tape[ptr + offsets[ip]]));
+                break;
+            case opcode(IRType::Input):
+                in.read(tape[ptr + offsets[ip]], out);
+                break;
+            case opcode(IRType::LoopBegin):
+                if (tape[ptr + offsets[ip]] == 0) {
+                    ip = args[ip];
+                }
+                break;
+            case opcode(IRType::LoopEnd):
+                if (tape[ptr + offsets[ip]] != 0) {
+                    ip = args[ip];
+                }
+                break;
+            case opcode(IRType::SetZero):
+                tape[ptr + offsets[ip]] = 0;
+                break;
+            case opcode(IRType::SetVal):
+                tape[ptr + offsets[ip]] = static_cast<Cell>(args[ip]);
+                break;
+            case opcode(IRType::MulAdd):
+                mul_add(ip);
+                break;
+            case opcode(IRType::ScanZero):
+                ptr = scan_zero(tape, ptr, args[ip], lo, hi);
+                break;
+
+            // 超级指令：执行完两条后 ip 停在第二条上，由循环末尾的 ++ip 越过
+            case opcode(SuperOp::AddValMovePtr):
+                add_val(ip);
+                ptr += args[++ip];
+                second();
+                break;
+            case opcode(SuperOp::MovePtrSetZero):
+                ptr += args[ip++];
+                tape[ptr + offsets[ip]] = 0;
+                second();
+                break;
+            case opcode(SuperOp::MulAddSetZero):
+                mul_add(ip++);
+                tape[ptr + offsets[ip]] = 0;
+                second();
+                break;
+            case opcode(SuperOp::LoopBeginAddVal):
+                if (tape[ptr + offsets[ip]] == 0) {
+                    ip = args[ip];
+                } else {
+                    add_val(++ip);
+                    second();
+                }
+                break;
+            case opcode(SuperOp::MovePtrScanZero):
+                ptr += args[ip++];
+                ptr = scan_zero(tape, ptr, args[ip], lo, hi);
+                second();
+                break;
+            case opcode(SuperOp::LoopEndMovePtr):
+                if (tape[ptr + offsets[ip]] != 0) {
+                    ip = args[ip];
+                } else {
+                    ptr += args[++ip];
+                    second();
+                }
+                break;
+            case opcode(SuperOp::AddValAddVal):
+                add_val(ip);
+                add_val(++ip);
+                second();
+                break;
+            case opcode(SuperOp::MovePtrLoopBegin):
+                ptr += args[ip++];
+                second();
+                if (tape[ptr + offsets[ip]] == 0) {
+                    ip = args[ip];
+                }
+                break;
+            case opcode(SuperOp::SetZeroLoopEnd):
+                tape[ptr + offsets[ip++]] = 0;
+                second();
+                if (tape[ptr + offsets[ip]] != 0) {
+                    ip = args[ip];
+                }
+                break;
+        }
+        ++ip;
+    }
+}
+
+template <Mode M>
+static void run_cells(const PackedProgram& program, const RunOptions& opts, uint64_t* counts,
+                      DispatchStats* stats) {
+    switch (opts.cell_bits) {
+        case 16: run<uint16_t, M>(program, opts, counts, stats); break;
+        case 32: run<uint32_t, M>(program, opts, counts, stats); break;
+        default: run<uint8_t, M>(program, opts, counts, stats); break;
+    }
+}
+
+void interpret(const PackedProgram& program, const RunOptions& opts) {
+    run_cells<Mode::Plain>(program, opts, nullptr, nullptr);
+}
+
+void interpret_counting(const PackedProgram& program, const RunOptions& opts,
+                        std::vector<uint64_t>& counts) {
+    counts.assign(program.size(), 0);
+    run_cells<Mode::Counting>(program, opts, counts.data(), nullptr);
+}
+
+void interpret_stats(const PackedProgram& program, const RunOptions& opts, DispatchStats& stats) {
+    stats = DispatchStats{};
+    run_cells<Mode::Stats>(program, opts, nullptr, &stats);
+}
+
+} // namespace bf
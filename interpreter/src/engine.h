@@ -0,0 +1,30 @@
+#pragma once
+#include "bf/packed_ir.h"
+#include "runtime.h"
+#include "superinst.h"
+#include <cstdint>
+#include <vector>
+
+namespace bf {
+
+// 分派统计：融合前每条 IR 指令各需一次分派，融合后一次分派可执行两条
+struct DispatchStats {
+    uint64_t instructions = 0;                  // 执行的 IR 指令数
+    uint64_t dispatches[OPCODE_COUNT] = {};     // 按操作码（含超级指令）统计的分派次数
+
+    uint64_t total_dispatches() const;
+};
+
+// switch 分派的可移植执行引擎，直接在 PackedProgram 上运行：
+// 主循环只顺序读 1 字节的操作码，需要时才访问 args/offsets。
+// opts.fuse 为 true 时先把常见的相邻指令对改写为超级指令（见 superinst.h）
+void interpret(const PackedProgram& program, const RunOptions& opts);
+
+// 同上，额外统计每条指令的执行次数，counts[i] 对应 program 的第 i 条指令（不融合）
+void interpret_counting(const PackedProgram& program, const RunOptions& opts,
+                        std::vector<uint64_t>& counts);
+
+// 同 interpret，额外统计执行的指令数和各操作码的分派次数
+void interpret_stats(const PackedProgram& program, const RunOptions& opts, DispatchStats& stats);
+
+} // namespace bf
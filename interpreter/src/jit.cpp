@@ -0,0 +1,110 @@
+#include "jit.h"
+#include "runtime.h"
+#include "tape.h"
+#include "bf/optimizer.h"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#if defined(__linux__) && defined(__x86_64__)
+#include "pe_codegen.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
+#include <stdexcept>
+#endif
+
+namespace bf {
+
+#if defined(__linux__) && defined(__x86_64__)
+
+bool jit_available() { return true; }
+
+// 把生成的代码映射进可执行内存，返回映射地址，len 为映射长度
+static void* map_code(const pe::CodeBuf& code, size_t& len) {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    len = (code.size() + page - 1) / page * page;
+    void* mem = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        throw std::runtime_error("JIT: mmap failed");
+    }
+    std::memcpy(mem, code.data.data(), code.size());
+    // W^X：写完后去掉写权限再加执行权限
+    if (mprotect(mem, len, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, len);
+        throw std::runtime_error("JIT: mprotect failed");
+    }
+    return mem;
+}
+
+void run_jit(const std::vector<IRInst>& program, const RunOptions& opts) {
+    // 生成的代码自带输出缓冲，输入缓冲区与解释器共用同一布局，容量都至少为 1
+    CodegenOptions cg;
+    cg.out_buffer = static_cast<uint32_t>(opts.out_buffer ? opts.out_buffer : 1);
+    cg.in_buffer = static_cast<uint32_t>(opts.in_buffer ? opts.in_buffer : 1);
+    cg.eof = opts.eof;
+    cg.cell_bits = opts.cell_bits;
+    pe::CodeBuf code;
+    pe::gen_code(program, code, pe::CodeTarget::linux_jit(cg));
+
+    size_t len = 0;
+    void* mem = map_code(code, len);
+
+    const size_t cell_bytes = cg.cell_bytes();
+    Tape tape(cell_bytes);
+    std::vector<uint8_t> outbuf(cg.out_buffer);
+    InputBuffer in(cg.in_buffer, cg.eof);
+    auto fn = reinterpret_cast<void (*)(uint8_t*, uint8_t*, InputHeader*)>(mem);
+    std::fflush(stdout); // 生成的代码直接写 fd 1
+    fn(tape.origin<uint8_t>(), outbuf.data(), in.header());
+
+    munmap(mem, len);
+}
+
+LoopCompiler::LoopCompiler(const RunOptions& opts, size_t out_capacity)
+    : opts_(opts), out_capacity_(out_capacity) {}
+
+LoopCompiler::~LoopCompiler() {
+    for (const auto& b : blocks_) munmap(b.first, b.second);
+}
+
+NativeLoop LoopCompiler::compile(const std::vector<IRInst>& program, size_t begin, size_t end) {
+    // 截出循环并把跳转目标改为相对 begin 的下标
+    std::vector<IRInst> loop(program.begin() + begin, program.begin() + end + 1);
+    for (auto& inst : loop) {
+        if (inst.type == IRType::Input && opts_.in_buffer == 0) return nullptr;
+        if (inst.type == IRType::LoopBegin || inst.type == IRType::LoopEnd)
+            inst.jump_target -= static_cast<int>(begin);
+    }
+
+    CodegenOptions cg;
+    cg.out_buffer = static_cast<uint32_t>(out_capacity_);
+    cg.in_buffer = static_cast<uint32_t>(opts_.in_buffer);
+    cg.eof = opts_.eof;
+    cg.cell_bits = opts_.cell_bits;
+    pe::CodeBuf code;
+    pe::gen_code(loop, code, pe::CodeTarget::linux_jit_loop(cg));
+
+    size_t len = 0;
+    void* mem = map_code(code, len);
+    blocks_.emplace_back(mem, len);
+    return reinterpret_cast<NativeLoop>(mem);
+}
+
+#else
+
+bool jit_available() { return false; }
+
+void run_jit(const std::vector<IRInst>&, const RunOptions&) {}
+
+LoopCompiler::LoopCompiler(const RunOptions& opts, size_t out_capacity)
+    : opts_(opts), out_capacity_(out_capacity) {}
+
+LoopCompiler::~LoopCompiler() = default;
+
+NativeLoop LoopCompiler::compile(const std::vector<IRInst>&, size_t, size_t) { return nullptr; }
+
+#endif
+
+} // namespace bf
@@ -0,0 +1,50 @@
+#pragma once
+#include "bf/ir.h"
+#include "runtime.h"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace bf {
+
+// 进程内 x86-64 JIT (仅 Linux)
+// 复用 compiler/src/pe_codegen.h 的机器码生成器，I/O 直接走 read/write 系统调用，
+// 代码映射进 W^X 的 mmap 缓冲区（先写后改为只读可执行）后直接调用
+void run_jit(const std::vector<IRInst>& program, const RunOptions& opts);
+
+// 当前平台是否支持 JIT
+bool jit_available();
+
+// 分层执行用的单个循环的本机代码：从 LoopBegin 执行到配对的 LoopEnd 之后返回。
+// p 为数据指针（字节地址），outbuf/pending 为调用方输出缓冲区及其中已有的字节数，
+// 缓冲区满或补充输入前才整体写出，返回时不写出；in 为调用方的输入缓冲区，
+// 本机代码直接在其上取字节和补充。返回新的数据指针和缓冲区中的字节数
+struct NativeLoopState {
+    uint8_t* p;
+    size_t pending;
+};
+using NativeLoop = NativeLoopState (*)(uint8_t* p, uint8_t* outbuf, size_t pending,
+                                       InputHeader* in);
+
+// 按需把热循环编译为本机代码，生成的代码在对象析构时释放
+class LoopCompiler {
+public:
+    // out_capacity 为调用方输出缓冲区的容量（至少为 1）
+    LoopCompiler(const RunOptions& opts, size_t out_capacity);
+    ~LoopCompiler();
+    LoopCompiler(const LoopCompiler&) = delete;
+    LoopCompiler& operator=(const LoopCompiler&) = delete;
+
+    // 编译 program[begin..end]（一对配对的括号及其循环体）。
+    // --in-buffer=0 时输入逐字节经过 stdio 的 getchar，本机代码无法共享其状态，
+    // 此时循环体含 Input 返回 nullptr，继续解释执行
+    NativeLoop compile(const std::vector<IRInst>& program, size_t begin, size_t end);
+
+private:
+    RunOptions opts_;
+    size_t out_capacity_;
+    std::vector<std::pair<void*, size_t>> blocks_; // mmap 的代码块及长度
+};
+
+} // namespace bf
@@ -1,73 +1,203 @@
-#include "bf/lexer.h"
-#include "bf/parser.h"
+#include "bf/frontend.h"
 #include "bf/optimizer.h"
+#include "runtime.h"
+#include "engine.h"
+#include "threaded.h"
+#include "jit.h"
+#include "profile.h"
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
-#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <vector>
 #include <cstdint>
 
-static constexpr int TAPE_SIZE = 30000;
+static void print_usage() {
+    std::cerr << "Usage:\n"
+              << "  bf-interpreter <input.bf>                    Run with switch engine\n"
+              << "  bf-interpreter <input.bf> --engine=switch    Portable switch dispatch (default)\n"
+              << "  bf-interpreter <input.bf> --engine=threaded  Direct-threaded computed-goto dispatch\n"
+              << "  bf-interpreter <input.bf> --engine=tiered    Threaded dispatch, hot loops compiled to x86-64 (Linux)\n"
+              << "  bf-interpreter <input.bf> --jit              Compile to native x86-64 in memory (Linux)\n"
+              << "  bf-interpreter <input.bf> --profile          Count executions per instruction and loop\n"
+              << "  bf-interpreter <input.bf> --stats            Report dispatches saved by superinstructions\n"
+              << "Options:\n"
+              << "  --out-buffer=N   Output buffer size in bytes (default 4096, 0 = putchar per byte)\n"
+              << "  --in-buffer=N    Input buffer size in bytes, refilled with read(2) (default 4096,\n"
+              << "                   0 = getchar per byte)\n"
+              << "  --eof=MODE       Cell value on end of input: unchanged, 0 or -1 (default -1)\n"
+              << "  --cell-bits=N    Cell width: 8 (default), 16 or 32, wrapping modulo 2^N\n"
+              << "  --profile-out=F  Collapsed-stack file for --profile (default <input>.folded)\n"
+              << "  --tier-threshold=N  Back edges before --engine=tiered compiles a loop (default 1000)\n"
+              << "  --no-fuse        Dispatch every IR instruction separately (no superinstructions)\n";
+}
 
-static void interpret(const std::vector<bf::IRInst>& program) {
-    std::vector<uint8_t> tape(TAPE_SIZE, 0);
-    int ptr = 0;
-    int ip = 0;
-    int size = static_cast<int>(program.size());
+// 融合前每条 IR 指令各分派一次，两者之差即超级指令省下的分派
+static void print_stats(const bf::DispatchStats& ds) {
+    uint64_t dispatches = ds.total_dispatches();
+    uint64_t saved = ds.instructions - dispatches;
+    double pct = ds.instructions ? 100.0 * saved / ds.instructions : 0.0;
+    std::cerr << "\nDispatch stats:\n"
+              << "  IR instructions executed " << std::setw(16) << ds.instructions << "\n"
+              << "  dispatches               " << std::setw(16) << dispatches << "\n"
+              << "  saved by fusion          " << std::setw(16) << saved
+              << std::fixed << std::setprecision(1) << " (" << pct << "%)\n";
 
-    while (ip < size) {
-        const auto& inst = program[ip];
-        switch (inst.type) {
-            case bf::IRType::MovePtr:
-                ptr += inst.operand;
-                break;
-            case bf::IRType::AddVal:
-                tape[ptr] += static_cast<uint8_t>(inst.operand);
-                break;
-            case bf::IRType::Output:
-                std::putchar(tape[ptr]);
-                break;
-            case bf::IRType::Input:
-                tape[ptr] = static_cast<uint8_t>(std::getchar());
-                break;
-            case bf::IRType::LoopBegin:
-                if (tape[ptr] == 0) {
-                    ip = inst.jump_target;
-                }
-                break;
-            case bf::IRType::LoopEnd:
-                if (tape[ptr] != 0) {
-                    ip = inst.jump_target;
-                }
-                break;
-            case bf::IRType::SetZero:
-                tape[ptr] = 0;
-                break;
-        }
-        ++ip;
+    std::vector<int> order;
+    for (int op = 0; op < bf::OPCODE_COUNT; ++op) {
+        if (ds.dispatches[op] != 0) order.push_back(op);
+    }
+    std::sort(order.begin(), order.end(),
+              [&](int a, int b) { return ds.dispatches[a] > ds.dispatches[b]; });
+    std::cerr << "\nDispatches by opcode:\n";
+    for (int op : order) {
+        double share = dispatches ? 100.0 * ds.dispatches[op] / dispatches : 0.0;
+        std::cerr << "  " << std::left << std::setw(24) << bf::opcode_name(static_cast<uint8_t>(op))
+                  << std::right << std::setw(16) << ds.dispatches[op]
+                  << std::setw(8) << share << "%\n";
     }
 }
 
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: bf-interpreter <input.bf>\n";
-        return 1;
+    if (argc < 2) { print_usage(); return 1; }
+
+    std::string input_file;
+    bool threaded = false;
+    bool tiered = false;
+    uint32_t tier_threshold = 1000;
+    bool jit = false;
+    bool profile = false;
+    bool stats = false;
+    std::string profile_out;
+    bf::RunOptions opts;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--engine=", 0) == 0) {
+            std::string e = arg.substr(9);
+            threaded = e == "threaded" || e == "tiered";
+            tiered = e == "tiered";
+            if (!threaded && e != "switch") {
+                std::cerr << "Unknown engine: " << e << "\n";
+                return 1;
+            }
+        } else if (arg.rfind("--out-buffer=", 0) == 0) {
+            long n = std::strtol(arg.c_str() + 13, nullptr, 10);
+            if (n < 0 || n > (1 << 24)) {
+                std::cerr << "Invalid output buffer size: " << arg.substr(13) << "\n";
+                return 1;
+            }
+            opts.out_buffer = static_cast<size_t>(n);
+        } else if (arg.rfind("--in-buffer=", 0) == 0) {
+            long n = std::strtol(arg.c_str() + 12, nullptr, 10);
+            if (n < 0 || n > (1 << 24)) {
+                std::cerr << "Invalid input buffer size: " << arg.substr(12) << "\n";
+                return 1;
+            }
+            opts.in_buffer = static_cast<size_t>(n);
+        } else if (arg.rfind("--eof=", 0) == 0) {
+            if (!bf::parse_eof_mode(arg.substr(6), opts.eof)) {
+                std::cerr << "Invalid EOF mode: " << arg.substr(6) << "\n";
+                return 1;
+            }
+        } else if (arg.rfind("--cell-bits=", 0) == 0) {
+            int n = std::atoi(arg.c_str() + 12);
+            if (!bf::valid_cell_bits(n)) {
+                std::cerr << "Invalid cell width: " << arg.substr(12) << "\n";
+                return 1;
+            }
+            opts.cell_bits = n;
+        } else if (arg.rfind("--tier-threshold=", 0) == 0) {
+            long n = std::strtol(arg.c_str() + 17, nullptr, 10);
+            if (n < 1 || n > 0x7FFFFFFF) {
+                std::cerr << "Invalid tier threshold: " << arg.substr(17) << "\n";
+                return 1;
+            }
+            tier_threshold = static_cast<uint32_t>(n);
+        } else if (arg == "--jit") {
+            jit = true;
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (arg == "--no-fuse") {
+            opts.fuse = false;
+        } else if (arg.rfind("--profile-out=", 0) == 0) {
+            profile = true;
+            profile_out = arg.substr(14);
+        } else if (arg[0] != '-') {
+            input_file = arg;
+        }
     }
 
-    std::ifstream file(argv[1]);
-    if (!file) {
-        std::cerr << "Error: cannot open file '" << argv[1] << "'\n";
+    if (input_file.empty()) { print_usage(); return 1; }
+
+    bf::PackedProgram program;
+    try {
+        program = bf::parse_file(input_file, profile);
+        bf::optimize_in_place(program, opts.cell_bits);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
         return 1;
     }
 
-    std::ostringstream ss;
-    ss << file.rdbuf();
-    std::string source = ss.str();
+    if (profile) {
+        if (jit || threaded) {
+            std::cerr << "Warning: --profile always uses the switch engine\n";
+        }
+        std::string name = input_file.substr(input_file.find_last_of("/\\") + 1);
+        name = name.substr(0, name.rfind('.'));
+        // 默认写在源文件旁边，与当前目录无关
+        if (profile_out.empty()) profile_out = input_file + ".folded";
+
+        std::vector<uint64_t> counts;
+        bf::interpret_counting(program, opts, counts);
 
-    auto tokens = bf::lex(source);
-    auto program = bf::parse(tokens);
-    program = bf::optimize(program);
-    interpret(program);
+        std::ofstream stacks(profile_out);
+        if (!stacks) {
+            std::cerr << "Error: cannot write '" << profile_out << "'\n";
+            return 1;
+        }
+        std::cerr << "\n";
+        bf::write_profile(program, counts, name, std::cerr, stacks);
+        std::cerr << "\nCollapsed stacks written to " << profile_out << "\n";
+        return 0;
+    }
+
+    if (stats) {
+        if (jit || threaded) {
+            std::cerr << "Warning: --stats always uses the switch engine\n";
+        }
+        bf::DispatchStats ds;
+        bf::interpret_stats(program, opts, ds);
+        print_stats(ds);
+        return 0;
+    }
+
+    if (jit && !bf::jit_available()) {
+        std::cerr << "Warning: JIT needs Linux on x86-64, falling back to interpreter\n";
+        jit = false;
+    }
+    if (threaded && !bf::threaded_engine_available()) {
+        std::cerr << "Warning: threaded engine needs GCC/Clang computed goto, "
+                     "falling back to switch\n";
+        threaded = false;
+        tiered = false;
+    }
+    if (tiered && !bf::jit_available()) {
+        std::cerr << "Warning: tiered engine needs Linux on x86-64, using threaded only\n";
+        tiered = false;
+    }
+    if (tiered) opts.tier_threshold = tier_threshold;
+    if (jit)
+        bf::run_jit(bf::unpack(program), opts);
+    else if (threaded)
+        bf::interpret_threaded(bf::unpack(program), opts);
+    else
+        bf::interpret(program, opts);
 
     return 0;
 }
@@ -0,0 +1,96 @@
+#include "profile.h"
+#include <algorithm>
+#include <iomanip>
+#include <map>
+
+namespace bf {
+
+// 报告中列出的热点循环和热点指令条数
+constexpr size_t PROFILE_TOP = 20;
+
+static std::string loc_str(SourceLoc loc) {
+    return std::to_string(loc.line) + ":" + std::to_string(loc.col);
+}
+
+struct LoopStat {
+    size_t begin;
+    uint64_t entries;    // 到达 '[' 的次数
+    uint64_t iterations; // 执行到 ']' 的次数，即循环体执行的轮数
+    uint64_t inclusive;  // 循环内（含嵌套循环）执行的指令数
+};
+
+void write_profile(const PackedProgram& program, const std::vector<uint64_t>& counts,
+                   const std::string& root, std::ostream& report, std::ostream& stacks) {
+    size_t n = program.size();
+    std::vector<uint64_t> prefix(n + 1, 0);
+    for (size_t i = 0; i < n; ++i) prefix[i + 1] = prefix[i] + counts[i];
+    uint64_t total = prefix[n];
+
+    // 循环体执行完一轮一定经过 LoopEnd；跳过循环时从 LoopBegin 直接跳到 LoopEnd 之后
+    std::vector<LoopStat> loops;
+    for (size_t i = 0; i < n; ++i) {
+        if (program.type(i) != IRType::LoopBegin) continue;
+        size_t end = static_cast<size_t>(program.args[i]);
+        loops.push_back({i, counts[i], counts[end], prefix[end + 1] - prefix[i]});
+    }
+
+    auto percent = [&](uint64_t v) { return total ? 100.0 * v / total : 0.0; };
+
+    report << "Profile: " << total << " IR instructions executed ("
+           << n << " instructions, " << loops.size() << " loops)\n";
+
+    std::sort(loops.begin(), loops.end(), [](const LoopStat& a, const LoopStat& b) {
+        return a.inclusive > b.inclusive;
+    });
+    report << "\nHot loops (instructions executed inside, including nested loops):\n"
+           << std::setw(6) << "rank" << std::setw(12) << "location"
+           << std::setw(14) << "entries" << std::setw(16) << "iterations"
+           << std::setw(12) << "avg trip" << std::setw(16) << "instructions"
+           << std::setw(9) << "%" << "\n";
+    for (size_t r = 0; r < loops.size() && r < PROFILE_TOP; ++r) {
+        const auto& l = loops[r];
+        if (l.inclusive == 0) break;
+        double trip = l.entries ? static_cast<double>(l.iterations) / l.entries : 0.0;
+        report << std::setw(6) << r + 1 << std::setw(12) << loc_str(program.loc(l.begin))
+               << std::setw(14) << l.entries << std::setw(16) << l.iterations
+               << std::fixed << std::setprecision(1) << std::setw(12) << trip
+               << std::setw(16) << l.inclusive << std::setw(8) << percent(l.inclusive) << "%\n";
+    }
+
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return counts[a] > counts[b]; });
+    report << "\nHot instructions:\n"
+           << std::setw(6) << "rank" << std::setw(12) << "location"
+           << "  " << std::left << std::setw(10) << "op" << std::right
+           << std::setw(16) << "count" << std::setw(9) << "%" << "\n";
+    for (size_t r = 0; r < n && r < PROFILE_TOP; ++r) {
+        size_t i = order[r];
+        if (counts[i] == 0) break;
+        report << std::setw(6) << r + 1 << std::setw(12) << loc_str(program.loc(i))
+               << "  " << std::left << std::setw(10) << ir_type_name(program.type(i)) << std::right
+               << std::setw(16) << counts[i]
+               << std::fixed << std::setprecision(1) << std::setw(8) << percent(counts[i]) << "%\n";
+    }
+
+    // 同一调用栈可能出现多次（如同一位置折叠出的多条 MulAdd），先合并再输出。
+    // ']' 记在循环自己的帧里，'[' 记在外层
+    std::map<std::string, uint64_t> folded;
+    std::vector<std::string> frames{root};
+    for (size_t i = 0; i < n; ++i) {
+        IRType t = program.type(i);
+        if (counts[i] != 0) {
+            std::string stack;
+            for (const auto& f : frames) stack += f + ";";
+            stack += ir_type_name(t) + "@" + loc_str(program.loc(i));
+            folded[stack] += counts[i];
+        }
+        if (t == IRType::LoopBegin) frames.push_back("loop@" + loc_str(program.loc(i)));
+        if (t == IRType::LoopEnd) frames.pop_back();
+    }
+    for (const auto& [stack, count] : folded) {
+        stacks << stack << " " << count << "\n";
+    }
+}
+
+} // namespace bf
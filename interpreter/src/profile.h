@@ -0,0 +1,18 @@
+#pragma once
+#include "bf/packed_ir.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace bf {
+
+// 根据 interpret_counting 得到的逐指令执行次数生成剖析结果（program 需带源码位置）：
+// - report: 按循环内执行指令数排序的热点循环（进入次数、迭代次数、平均迭代次数）
+//           以及执行最多的指令，位置均为源码行:列
+// - stacks: collapsed stack 格式（"帧;帧;帧 次数"），可直接交给 flamegraph.pl，
+//           每层循环一个帧，叶子为指令本身，权重为执行次数
+void write_profile(const PackedProgram& program, const std::vector<uint64_t>& counts,
+                   const std::string& root, std::ostream& report, std::ostream& stacks);
+
+} // namespace bf
@@ -0,0 +1,162 @@
+#pragma once
+#include "bf/input.h"
+#include "bf/optimizer.h"
+#include "tape.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace bf {
+
+// 各执行引擎共享的运行选项
+struct RunOptions {
+    size_t out_buffer = 4096; // 输出缓冲字节数，0 表示逐字节 putchar
+    size_t in_buffer = 4096;  // 输入缓冲字节数，0 表示逐字节 getchar
+    EofMode eof = EofMode::MinusOne; // 读到 EOF 时单元格的值，默认与 (Cell)getchar() 一致
+    int cell_bits = 8;        // 单元格位数 8/16/32，各引擎按宽度实例化
+    bool fuse = true;         // 解释引擎是否在预解码时融合超级指令
+    uint32_t tier_threshold = 0; // threaded 引擎中循环回边达到该次数后编译为本机代码，0 表示不分层
+};
+
+// 批量输出：攒满缓冲区、读输入前和结束时才整体写出一次
+class OutputBuffer {
+public:
+    explicit OutputBuffer(size_t capacity) : buf_(capacity) {}
+    ~OutputBuffer() { flush(); }
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void put(uint8_t c) {
+        if (buf_.empty()) {
+            std::putchar(c);
+            return;
+        }
+        buf_[pos_++] = c;
+        if (pos_ == buf_.size()) flush();
+    }
+
+    void flush() {
+        if (pos_ != 0) {
+            std::fwrite(buf_.data(), 1, pos_, stdout);
+            pos_ = 0;
+        }
+        std::fflush(stdout);
+    }
+
+    // 分层执行的本机代码直接写入缓冲区，进出时交接已有的字节数
+    uint8_t* data() { return buf_.data(); }
+    size_t pending() const { return pos_; }
+    void set_pending(size_t n) { pos_ = n; }
+
+private:
+    std::vector<uint8_t> buf_;
+    size_t pos_ = 0;
+};
+
+// 批量输入：取完时先写出待输出的内容，再用一次 read(2) 读满缓冲区，不经过 stdio 及其加锁。
+// 内存布局见 bf/input.h，--jit 生成的代码直接在同一块缓冲区上取字节和补充
+class InputBuffer {
+public:
+    InputBuffer(size_t capacity, EofMode eof)
+        : mem_(sizeof(InputHeader) + capacity), capacity_(capacity), eof_(eof) {}
+    InputBuffer(const InputBuffer&) = delete;
+    InputBuffer& operator=(const InputBuffer&) = delete;
+
+    // 读一个字节存入 cell，EOF 时按 eof 模式处理
+    template <typename Cell>
+    void read(Cell& cell, OutputBuffer& out) {
+        int c = get(out);
+        if (c >= 0) cell = static_cast<Cell>(c);
+        else if (eof_ == EofMode::Zero) cell = 0;
+        else if (eof_ == EofMode::MinusOne) cell = static_cast<Cell>(-1);
+    }
+
+    InputHeader* header() { return reinterpret_cast<InputHeader*>(mem_.data()); }
+
+private:
+    // 下一个字节，EOF 或出错时返回 -1；容量为 0 时逐字节 getchar
+    int get(OutputBuffer& out) {
+        if (capacity_ == 0) {
+            out.flush();
+            return std::getchar();
+        }
+        InputHeader* h = header();
+        if (h->pos == h->len) {
+            out.flush();
+            uint8_t* data = mem_.data() + sizeof(InputHeader);
+#ifdef _WIN32
+            long n = _read(0, data, static_cast<unsigned>(capacity_));
+#else
+            long n = static_cast<long>(::read(0, data, capacity_));
+#endif
+            if (n <= 0) return -1;
+            h->pos = 0;
+            h->len = static_cast<uint64_t>(n);
+        }
+        return mem_[sizeof(InputHeader) + h->pos++];
+    }
+
+    std::vector<uint8_t> mem_;
+    size_t capacity_;
+    EofMode eof_;
+};
+
+// ScanZero: 从 ptr 开始按 stride 步长寻找第一个 0 单元格，块操作限制在 tape 的 [lo, hi) 内
+// stride 1 用 memchr，-1 用 memrchr (glibc)，±2/±4 用 SSE2 比较 + 掩码，其余逐个检查
+inline int scan_zero(const uint8_t* tape, int ptr, int stride, int lo, int hi) {
+    if (stride == 1) {
+        const void* p = std::memchr(tape + ptr, 0, hi - ptr);
+        if (p) return static_cast<int>(static_cast<const uint8_t*>(p) - tape);
+        ptr = hi;
+    }
+#ifdef __GLIBC__
+    else if (stride == -1) {
+        const void* p = memrchr(tape + lo, 0, ptr + 1 - lo);
+        if (p) return static_cast<int>(static_cast<const uint8_t*>(p) - tape);
+        ptr = lo - 1;
+    }
+#endif
+#ifdef __SSE2__
+    else if (stride == 2 || stride == 4) {
+        // 16字节块中第 0, s, 2s... 字节是候选位置
+        const int mask = stride == 2 ? 0x5555 : 0x1111;
+        const __m128i zero = _mm_setzero_si128();
+        while (ptr + 16 <= hi) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tape + ptr));
+            int hits = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & mask;
+            if (hits) return ptr + __builtin_ctz(hits);
+            ptr += 16;
+        }
+    } else if (stride == -1 || stride == -2 || stride == -4) {
+        // 块以 ptr 结尾，候选位置是第 15, 15-s, 15-2s... 字节
+        const int mask = stride == -1 ? 0xFFFF : stride == -2 ? 0xAAAA : 0x8888;
+        const __m128i zero = _mm_setzero_si128();
+        while (ptr - 15 >= lo) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tape + ptr - 15));
+            int hits = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) & mask;
+            if (hits) return ptr - 15 + (31 - __builtin_clz(hits));
+            ptr -= 16;
+        }
+    }
+#endif
+    while (tape[ptr] != 0) ptr += stride;
+    return ptr;
+}
+
+// 16/32 位单元格的 ScanZero：逐个检查
+template <typename Cell>
+inline int scan_zero(const Cell* tape, int ptr, int stride, int, int) {
+    while (tape[ptr] != 0) ptr += stride;
+    return ptr;
+}
+
+} // namespace bf
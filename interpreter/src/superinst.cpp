@@ -0,0 +1,51 @@
+#include "superinst.h"
+
+namespace bf {
+
+struct SuperPattern {
+    IRType first;
+    IRType second;
+    SuperOp op;
+};
+
+static const SuperPattern PATTERNS[] = {
+    {IRType::AddVal,    IRType::MovePtr,   SuperOp::AddValMovePtr},
+    {IRType::MovePtr,   IRType::SetZero,   SuperOp::MovePtrSetZero},
+    {IRType::MulAdd,    IRType::SetZero,   SuperOp::MulAddSetZero},
+    {IRType::LoopBegin, IRType::AddVal,    SuperOp::LoopBeginAddVal},
+    {IRType::MovePtr,   IRType::ScanZero,  SuperOp::MovePtrScanZero},
+    {IRType::LoopEnd,   IRType::MovePtr,   SuperOp::LoopEndMovePtr},
+    {IRType::AddVal,    IRType::AddVal,    SuperOp::AddValAddVal},
+    {IRType::MovePtr,   IRType::LoopBegin, SuperOp::MovePtrLoopBegin},
+    {IRType::SetZero,   IRType::LoopEnd,   SuperOp::SetZeroLoopEnd},
+};
+
+uint8_t match_superinstruction(IRType a, IRType b) {
+    for (const auto& p : PATTERNS) {
+        if (p.first == a && p.second == b) return static_cast<uint8_t>(p.op);
+    }
+    return 0;
+}
+
+std::vector<uint8_t> fuse_superinstructions(const std::vector<uint8_t>& ops) {
+    std::vector<uint8_t> fused(ops);
+    for (size_t i = 0; i + 1 < ops.size(); ++i) {
+        uint8_t op = match_superinstruction(static_cast<IRType>(ops[i]),
+                                            static_cast<IRType>(ops[i + 1]));
+        if (op != 0) {
+            fused[i] = op;
+            ++i;
+        }
+    }
+    return fused;
+}
+
+std::string opcode_name(uint8_t op) {
+    for (const auto& p : PATTERNS) {
+        if (static_cast<uint8_t>(p.op) == op)
+            return ir_type_name(p.first) + ";" + ir_type_name(p.second);
+    }
+    return ir_type_name(static_cast<IRType>(op));
+}
+
+} // namespace bf
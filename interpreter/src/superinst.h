@@ -0,0 +1,38 @@
+#pragma once
+#include "bf/ir.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace bf {
+
+// 超级指令：把优化后 IR 中常见的相邻两条指令合成一次分派。
+// 模式按 bf-ngrams 对 tests/ 的静态 2-gram 统计选出（取前 9 名，合计约占全部相邻对的 50%），
+// 改动优化器使 IR 的形状变化时应重新统计。
+// 操作码紧接在 IRType 之后编号；融合只改写头一条的操作码，第二条保持原样，
+// 跳转落到第二条上时照常按单条指令执行。
+enum class SuperOp : uint8_t {
+    AddValMovePtr = static_cast<uint8_t>(IRType::SetVal) + 1,
+    MovePtrSetZero,
+    MulAddSetZero,
+    LoopBeginAddVal,
+    MovePtrScanZero,
+    LoopEndMovePtr,
+    AddValAddVal,
+    MovePtrLoopBegin,
+    SetZeroLoopEnd,
+};
+
+// IRType 与 SuperOp 合起来的操作码个数
+constexpr int OPCODE_COUNT = static_cast<int>(SuperOp::SetZeroLoopEnd) + 1;
+
+// a 后紧跟 b 时对应的超级指令操作码，没有时返回 0
+uint8_t match_superinstruction(IRType a, IRType b);
+
+// 从左到右贪心地两两融合，返回改写后的操作码流（与 ops 等长）
+std::vector<uint8_t> fuse_superinstructions(const std::vector<uint8_t>& ops);
+
+// 操作码名称，超级指令为 "A;B"
+std::string opcode_name(uint8_t op);
+
+} // namespace bf
@@ -0,0 +1,79 @@
+#include "tape.h"
+#include "bf/optimizer.h"
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define BF_MMAP_TAPE 1
+#endif
+
+namespace bf {
+
+#ifdef BF_MMAP_TAPE
+
+// 两端保护区的大小。IR 中的偏移通常远小于此，越界的访问会落在保护区内
+static const size_t GUARD_BYTES = 16u << 20;
+
+// 当前 tape 的两段保护区，供 SIGSEGV 处理函数判断出错地址
+static volatile uintptr_t guard_lo = 0;
+static volatile uintptr_t guard_hi = 0;
+
+static void on_segv(int sig, siginfo_t* info, void*) {
+    uintptr_t addr = reinterpret_cast<uintptr_t>(info->si_addr);
+    bool in_guard = guard_lo != 0 && ((addr >= guard_lo && addr < guard_lo + GUARD_BYTES) ||
+                                      (addr >= guard_hi && addr < guard_hi + GUARD_BYTES));
+    if (in_guard) {
+        static const char msg[] = "Error: data pointer moved outside the tape\n";
+        ssize_t r = write(2, msg, sizeof(msg) - 1);
+        (void)r;
+        _exit(1);
+    }
+    // 与 tape 无关的错误：恢复默认处理，返回后重新触发
+    signal(sig, SIG_DFL);
+}
+
+Tape::Tape(size_t cell_bytes) {
+    map_len_ = GUARD_BYTES + 2 * size_t{TAPE_RESERVE} + GUARD_BYTES;
+    void* mem = mmap(nullptr, map_len_, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) throw std::runtime_error("cannot reserve tape memory");
+    map_ = static_cast<uint8_t*>(mem);
+    if (mprotect(map_ + GUARD_BYTES, 2 * size_t{TAPE_RESERVE}, PROT_READ | PROT_WRITE) != 0) {
+        munmap(map_, map_len_);
+        throw std::runtime_error("cannot reserve tape memory");
+    }
+    origin_ = map_ + GUARD_BYTES + TAPE_RESERVE;
+    int half = static_cast<int>(TAPE_RESERVE / cell_bytes);
+    lo_ = -half + TAPE_MARGIN;
+    hi_ = half - TAPE_MARGIN;
+
+    guard_lo = reinterpret_cast<uintptr_t>(map_);
+    guard_hi = reinterpret_cast<uintptr_t>(map_ + map_len_ - GUARD_BYTES);
+    struct sigaction sa = {};
+    sa.sa_sigaction = on_segv;
+    sa.sa_flags = SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, nullptr);
+    sigaction(SIGBUS, &sa, nullptr); // macOS 上访问 PROT_NONE 页面报告 SIGBUS
+}
+
+Tape::~Tape() {
+    guard_lo = guard_hi = 0;
+    munmap(map_, map_len_);
+}
+
+#else
+
+Tape::Tape(size_t cell_bytes) : fallback_((TAPE_SIZE + 2 * TAPE_MARGIN) * cell_bytes, 0) {
+    origin_ = fallback_.data() + TAPE_MARGIN * cell_bytes;
+    lo_ = 0;
+    hi_ = TAPE_SIZE;
+}
+
+Tape::~Tape() = default;
+
+#endif
+
+} // namespace bf
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace bf {
+
+// 各执行引擎共用的 tape。
+// 类 Unix 平台上用 mmap 保留原点两侧各 TAPE_RESERVE 字节的地址空间（不预先提交内存），
+// 页面在首次访问时由内核按需分配，访存路径上不做边界检查；原点左侧的负下标同样可用。
+// 保留区两端各有一段不可访问的保护区，越界访问触发 SIGSEGV，报告错误后退出，
+// 不会悄悄改写其他内存。其他平台退回固定大小的 TAPE_SIZE 个单元格。
+class Tape {
+public:
+    explicit Tape(size_t cell_bytes);
+    ~Tape();
+    Tape(const Tape&) = delete;
+    Tape& operator=(const Tape&) = delete;
+
+    // 下标 0 的单元格
+    template <typename Cell>
+    Cell* origin() const { return reinterpret_cast<Cell*>(origin_); }
+
+    // 可用的单元格下标范围 [lo, hi)，两端各留 TAPE_MARGIN 个单元格给整块读取的扫描
+    int lo() const { return lo_; }
+    int hi() const { return hi_; }
+
+private:
+    uint8_t* map_ = nullptr; // mmap 的整个区域（含保护区）
+    size_t map_len_ = 0;
+    std::vector<uint8_t> fallback_;
+    uint8_t* origin_ = nullptr;
+    int lo_ = 0;
+    int hi_ = 0;
+};
+
+} // namespace bf
@@ -0,0 +1,225 @@
+#include "threaded.h"
+#include "jit.h"
+#include "runtime.h"
+#include "superinst.h"
+#include "bf/optimizer.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace bf {
+
+#if defined(__GNUC__)
+
+// 预解码后的一条指令：24字节，循环指令直接持有目标指令的指针和判断的单元格偏移
+struct ThreadedOp {
+    const void* handler;
+    union {
+        struct { int32_t operand; int32_t offset; int32_t src_offset; } arg;
+        struct { const ThreadedOp* target; int32_t offset; } loop;
+    };
+};
+
+bool threaded_engine_available() { return true; }
+
+// Cell 为单元格类型，每种宽度各自实例化一份分派代码
+template <typename Cell>
+static void run_threaded(const std::vector<IRInst>& program, const RunOptions& opts) {
+    // 顺序与 IRType 枚举、其后的 SuperOp 枚举一致
+    static const void* const handlers[OPCODE_COUNT] = {
+        &&op_move_ptr, &&op_add_val, &&op_output, &&op_input,
+        &&op_loop_begin, &&op_loop_end, &&op_set_zero, &&op_mul_add,
+        &&op_scan_zero, &&op_set_val,
+        &&op_add_val_move_ptr, &&op_move_ptr_set_zero, &&op_mul_add_set_zero,
+        &&op_loop_begin_add_val, &&op_move_ptr_scan_zero, &&op_loop_end_move_ptr,
+        &&op_add_val_add_val, &&op_move_ptr_loop_begin, &&op_set_zero_loop_end,
+    };
+
+    // 预解码：多出的最后一条是 halt
+    std::vector<ThreadedOp> code(program.size() + 1);
+    for (size_t i = 0; i < program.size(); ++i) {
+        const auto& inst = program[i];
+        auto& op = code[i];
+        op.handler = handlers[static_cast<int>(inst.type)];
+        if (inst.type == IRType::LoopBegin || inst.type == IRType::LoopEnd) {
+            // 跳到配对括号的下一条指令
+            op.loop.target = &code[inst.jump_target + 1];
+            op.loop.offset = inst.offset;
+        } else {
+            op.arg.operand = inst.operand;
+            op.arg.offset = inst.offset;
+            op.arg.src_offset = inst.src_offset;
+        }
+    }
+    code.back().handler = &&op_halt;
+
+    // 分层执行：LoopEnd 改用计数回边的 handler，见 op_loop_end_tier
+    const bool tiering = opts.tier_threshold != 0;
+    if (tiering) {
+        for (size_t i = 0; i < program.size(); ++i) {
+            if (program[i].type == IRType::LoopEnd) code[i].handler = &&op_loop_end_tier;
+        }
+    }
+    // 分层时回边必须经过计数的 LoopEnd，循环头必须经过可改写的 LoopBegin
+    auto fusable = [&](size_t i) {
+        return !tiering || (program[i].type != IRType::LoopEnd &&
+                            program[i + 1].type != IRType::LoopEnd &&
+                            program[i + 1].type != IRType::LoopBegin);
+    };
+
+    // 超级指令：只替换头一条的 handler，第二条的操作数原样留在 ip[1] 中
+    if (opts.fuse) {
+        for (size_t i = 0; i + 1 < program.size(); ++i) {
+            uint8_t op = match_superinstruction(program[i].type, program[i + 1].type);
+            if (op != 0 && fusable(i)) {
+                code[i].handler = handlers[op];
+                ++i;
+            }
+        }
+    }
+
+    Tape tape_buf(sizeof(Cell));
+    Cell* const tape = tape_buf.origin<Cell>();
+    const int lo = tape_buf.lo(), hi = tape_buf.hi();
+    Cell* p = tape;
+    // 本机代码直接写入输出缓冲区，分层时容量至少为 1
+    OutputBuffer out(tiering ? std::max<size_t>(opts.out_buffer, 1) : opts.out_buffer);
+    InputBuffer in(opts.in_buffer, opts.eof);
+    const ThreadedOp* const base = code.data();
+    const ThreadedOp* ip = base;
+
+    // 分层执行的状态：各 LoopEnd 的回边计数、各 LoopBegin 编译出的本机代码
+    std::vector<uint32_t> back_edges(tiering ? code.size() : 0);
+    std::vector<NativeLoop> natives(tiering ? code.size() : 0);
+    LoopCompiler compiler(opts, std::max<size_t>(opts.out_buffer, 1));
+
+#define DISPATCH() goto *ip->handler
+#define NEXT() do { ++ip; DISPATCH(); } while (0)
+#define NEXT2() do { ip += 2; DISPATCH(); } while (0)
+
+    DISPATCH();
+
+op_move_ptr:
+    p += ip->arg.operand;
+    NEXT();
+op_add_val:
+    p[ip->arg.offset] += static_cast<Cell>(ip->arg.operand);
+    NEXT();
+op_output:
+    out.put(static_cast<uint8_t>(p[ip->arg.offset]));
+    NEXT();
+op_input:
+    in.read(p[ip->arg.offset], out);
+    NEXT();
+op_loop_begin:
+    if (p[ip->loop.offset] == 0) { ip = ip->loop.target; DISPATCH(); }
+    NEXT();
+op_loop_end:
+    if (p[ip->loop.offset] != 0) { ip = ip->loop.target; DISPATCH(); }
+    NEXT();
+op_set_zero:
+    p[ip->arg.offset] = 0;
+    NEXT();
+op_mul_add:
+    p[ip->arg.offset] +=
+        static_cast<Cell>(uint32_t{p[ip->arg.src_offset]} * static_cast<uint32_t>(ip->arg.operand));
+    NEXT();
+op_scan_zero:
+    p = tape + scan_zero(tape, static_cast<int>(p - tape), ip->arg.operand, lo, hi);
+    NEXT();
+op_set_val:
+    p[ip->arg.offset] = static_cast<Cell>(ip->arg.operand);
+    NEXT();
+
+op_add_val_move_ptr:
+    p[ip->arg.offset] += static_cast<Cell>(ip->arg.operand);
+    p += ip[1].arg.operand;
+    NEXT2();
+op_move_ptr_set_zero:
+    p += ip->arg.operand;
+    p[ip[1].arg.offset] = 0;
+    NEXT2();
+op_mul_add_set_zero:
+    p[ip->arg.offset] +=
+        static_cast<Cell>(uint32_t{p[ip->arg.src_offset]} * static_cast<uint32_t>(ip->arg.operand));
+    p[ip[1].arg.offset] = 0;
+    NEXT2();
+op_loop_begin_add_val:
+    if (p[ip->loop.offset] == 0) { ip = ip->loop.target; DISPATCH(); }
+    p[ip[1].arg.offset] += static_cast<Cell>(ip[1].arg.operand);
+    NEXT2();
+op_move_ptr_scan_zero:
+    p += ip->arg.operand;
+    p = tape + scan_zero(tape, static_cast<int>(p - tape), ip[1].arg.operand, lo, hi);
+    NEXT2();
+op_loop_end_move_ptr:
+    if (p[ip->loop.offset] != 0) { ip = ip->loop.target; DISPATCH(); }
+    p += ip[1].arg.operand;
+    NEXT2();
+op_add_val_add_val:
+    p[ip->arg.offset] += static_cast<Cell>(ip->arg.operand);
+    p[ip[1].arg.offset] += static_cast<Cell>(ip[1].arg.operand);
+    NEXT2();
+op_move_ptr_loop_begin:
+    p += ip->arg.operand;
+    ++ip;
+    if (p[ip->loop.offset] == 0) { ip = ip->loop.target; DISPATCH(); }
+    NEXT();
+op_set_zero_loop_end:
+    p[ip->arg.offset] = 0;
+    ++ip;
+    if (p[ip->loop.offset] != 0) { ip = ip->loop.target; DISPATCH(); }
+    NEXT();
+
+// 分层执行：回边次数达到阈值时把整个循环编译为本机代码，改写 LoopBegin 的 handler，
+// 此后（包括本次）从循环头进入的执行都直接跳进本机代码
+op_loop_end_tier:
+    if (p[ip->loop.offset] == 0) NEXT();
+    if (++back_edges[ip - base] < opts.tier_threshold) { ip = ip->loop.target; DISPATCH(); }
+    {
+        size_t end = static_cast<size_t>(ip - base);
+        size_t begin = static_cast<size_t>(program[end].jump_target);
+        NativeLoop fn = compiler.compile(program, begin, end);
+        code[end].handler = &&op_loop_end; // 不再计数
+        if (fn == nullptr) { ip = ip->loop.target; DISPATCH(); }
+        natives[begin] = fn;
+        code[begin].handler = &&op_native;
+        // 当前单元格非 0，从 LoopBegin 重新进入与继续下一轮迭代等价
+        ip = &code[begin];
+        DISPATCH();
+    }
+op_native:
+    {
+        NativeLoopState st = natives[ip - base](reinterpret_cast<uint8_t*>(p), out.data(),
+                                                out.pending(), in.header());
+        p = reinterpret_cast<Cell*>(st.p);
+        out.set_pending(st.pending);
+        ip = ip->loop.target;
+        DISPATCH();
+    }
+op_halt:
+    return;
+
+#undef NEXT2
+#undef NEXT
+#undef DISPATCH
+}
+
+void interpret_threaded(const std::vector<IRInst>& program, const RunOptions& opts) {
+    switch (opts.cell_bits) {
+        case 16: run_threaded<uint16_t>(program, opts); break;
+        case 32: run_threaded<uint32_t>(program, opts); break;
+        default: run_threaded<uint8_t>(program, opts); break;
+    }
+}
+
+#else
+
+bool threaded_engine_available() { return false; }
+
+void interpret_threaded(const std::vector<IRInst>&, const RunOptions&) {}
+
+#endif
+
+} // namespace bf
@@ -0,0 +1,18 @@
+#pragma once
+#include "bf/ir.h"
+#include "runtime.h"
+#include <vector>
+
+namespace bf {
+
+// 直接线索化 (direct-threaded) 执行引擎
+// 先把优化后的 IR 预解码为 {handler 地址, 操作数 | 跳转目标指针} 的紧凑字节码，
+// 再用 GCC/Clang 的 computed goto 逐条分派，避免 switch 的集中间接跳转。
+// opts.tier_threshold 不为 0 时分层执行：LoopEnd 统计回边次数，达到阈值的循环
+// 用 LoopCompiler（见 jit.h）编译为本机代码，并改写该循环 LoopBegin 的 handler
+void interpret_threaded(const std::vector<IRInst>& program, const RunOptions& opts);
+
+// 当前编译器是否支持 computed goto (labels as values)
+bool threaded_engine_available();
+
+} // namespace bf
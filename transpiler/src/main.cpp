@@ -1,121 +1,196 @@
+#include "bf/batch.h"
+#include "bf/cache.h"
+#include "bf/frontend.h"
 #include "bf/lexer.h"
-#include "bf/parser.h"
 #include "bf/optimizer.h"
+#include "transpile.h"
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <sstream>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
-static std::string transpile_to_c(const std::vector<bf::IRInst>& program) {
-    std::ostringstream out;
-    int indent = 1;
+// 输出形式：c 为逐条移动指针的 C，c-indexed 为按下标访问、restrict 限定缓冲区的 C，llvm 为 LLVM IR 文本
+enum class Emit { C, CIndexed, LLVM };
 
-    out << "#include <stdio.h>\n";
-    out << "#include <string.h>\n\n";
-    out << "int main(void) {\n";
-    out << "    unsigned char tape[30000];\n";
-    out << "    memset(tape, 0, sizeof(tape));\n";
-    out << "    unsigned char *ptr = tape;\n\n";
+static void print_usage() {
+    std::cerr << "Usage: bf-transpiler <input.bf> [-o output.c] [--cell-bits=8|16|32]\n"
+              << "       bf-transpiler --batch <inputs...> [-o dir] [-j N] [--cell-bits=8|16|32]\n"
+              << "       (batch inputs: files, directories of .bf files, @listfile)\n"
+              << "       --emit=c|c-indexed|llvm: pointer-based C (default), tape[p + k] indexing\n"
+              << "                                with restrict buffers, or LLVM IR text (.ll)\n"
+              << "       --cache / --cache-dir=D: reuse outputs from the compilation cache\n";
+}
 
-    auto emit_indent = [&]() {
-        for (int i = 0; i < indent; ++i) out << "    ";
-    };
+// 默认输出文件名：替换扩展名为 .c，LLVM IR 为 .ll
+static std::string default_output(const std::string& input_file, Emit emit) {
+    const char* ext = emit == Emit::LLVM ? ".ll" : ".c";
+    auto dot = input_file.rfind('.');
+    if (dot != std::string::npos)
+        return input_file.substr(0, dot) + ext;
+    return input_file + ext;
+}
 
-    for (const auto& inst : program) {
-        switch (inst.type) {
-            case bf::IRType::MovePtr:
-                emit_indent();
-                if (inst.operand > 0)
-                    out << "ptr += " << inst.operand << ";\n";
-                else
-                    out << "ptr -= " << -inst.operand << ";\n";
-                break;
-            case bf::IRType::AddVal:
-                emit_indent();
-                if (inst.operand > 0)
-                    out << "*ptr += " << inst.operand << ";\n";
-                else
-                    out << "*ptr -= " << -inst.operand << ";\n";
-                break;
-            case bf::IRType::Output:
-                emit_indent();
-                out << "putchar(*ptr);\n";
-                break;
-            case bf::IRType::Input:
-                emit_indent();
-                out << "*ptr = (unsigned char)getchar();\n";
-                break;
-            case bf::IRType::LoopBegin:
-                emit_indent();
-                out << "while (*ptr) {\n";
-                ++indent;
-                break;
-            case bf::IRType::LoopEnd:
-                --indent;
-                emit_indent();
-                out << "}\n";
-                break;
-            case bf::IRType::SetZero:
-                emit_indent();
-                out << "*ptr = 0;\n";
-                break;
-        }
+// 转译一个文件并写出结果，cache 不为空时先查缓存，返回是否命中。
+// 可以在多个线程上同时调用。出错时抛出 std::runtime_error
+static bool transpile_file(const std::string& input_file, const std::string& output_file,
+                           int cell_bits, Emit emit, const bf::CompileCache* cache) {
+    bf::PackedProgram packed;
+    std::string key;
+    if (cache) {
+        std::string source = bf::read_file(input_file);
+        key = bf::CompileCache::key(bf::lex(source),
+                                    "bf-transpiler cell_bits=" + std::to_string(cell_bits) +
+                                        (emit == Emit::CIndexed ? " emit=c-indexed"
+                                         : emit == Emit::LLVM   ? " emit=llvm"
+                                                                : ""));
+        if (cache->fetch(key, output_file)) return true;
+        packed = bf::parse_source(source.data(), source.size());
+    } else {
+        packed = bf::parse_file(input_file);
     }
+    bf::optimize_in_place(packed, cell_bits);
+    std::vector<bf::IRInst> program = bf::unpack(packed);
+    std::string c_code = emit == Emit::CIndexed ? bf::transpile_to_c_indexed(program, cell_bits)
+                         : emit == Emit::LLVM   ? bf::transpile_to_llvm(program, cell_bits)
+                                                : bf::transpile_to_c(program, cell_bits);
 
-    out << "\n    return 0;\n";
-    out << "}\n";
-    return out.str();
+    std::ofstream out(output_file);
+    if (!out) throw std::runtime_error("cannot write to '" + output_file + "'");
+    out << c_code;
+    out.close();
+    if (cache) cache->store(key, output_file);
+    return false;
 }
 
 int main(int argc, char* argv[]) {
     if (argc < 2) {
-        std::cerr << "Usage: bf-transpiler <input.bf> [-o output.c]\n";
+        print_usage();
         return 1;
     }
 
-    std::string input_file = argv[1];
+    std::vector<std::string> inputs;
     std::string output_file;
+    int cell_bits = 8;
+    Emit emit = Emit::C;
+    bool batch = false;
+    unsigned jobs = 0;
+    bool use_cache = false;
+    std::string cache_dir;
 
-    // 解析 -o 参数
-    for (int i = 2; i < argc; ++i) {
-        if (std::string(argv[i]) == "-o" && i + 1 < argc) {
+    // 解析 -o、--cell-bits 和批量模式参数
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc) {
             output_file = argv[++i];
+        } else if (arg.rfind("--cell-bits=", 0) == 0) {
+            cell_bits = std::atoi(arg.c_str() + 12);
+            if (!bf::valid_cell_bits(cell_bits)) {
+                std::cerr << "Invalid cell width: " << arg.substr(12) << "\n";
+                return 1;
+            }
+        } else if (arg.rfind("--emit=", 0) == 0) {
+            std::string v = arg.substr(7);
+            if (v == "c") {
+                emit = Emit::C;
+            } else if (v == "c-indexed") {
+                emit = Emit::CIndexed;
+            } else if (v == "llvm") {
+                emit = Emit::LLVM;
+            } else {
+                std::cerr << "Unknown output form: " << v << "\n";
+                return 1;
+            }
+        } else if (arg == "--batch") {
+            batch = true;
+        } else if ((arg == "-j" && i + 1 < argc) || arg.rfind("--jobs=", 0) == 0) {
+            std::string v = arg == "-j" ? argv[++i] : arg.substr(7);
+            long n = std::strtol(v.c_str(), nullptr, 10);
+            if (n < 1 || n > 1024) {
+                std::cerr << "Invalid job count: " << v << "\n";
+                return 1;
+            }
+            jobs = static_cast<unsigned>(n);
+        } else if (arg == "--cache") {
+            use_cache = true;
+        } else if (arg.rfind("--cache-dir=", 0) == 0) {
+            use_cache = true;
+            cache_dir = arg.substr(12);
+        } else if (arg[0] != '-') {
+            inputs.push_back(arg);
         }
     }
 
-    if (output_file.empty()) {
-        // 默认输出文件名：替换扩展名为 .c
-        output_file = input_file;
-        auto dot = output_file.rfind('.');
-        if (dot != std::string::npos)
-            output_file = output_file.substr(0, dot) + ".c";
-        else
-            output_file += ".c";
+    if (inputs.empty()) {
+        print_usage();
+        return 1;
     }
-
-    std::ifstream file(input_file);
-    if (!file) {
-        std::cerr << "Error: cannot open file '" << input_file << "'\n";
+    if (inputs.size() > 1 && !batch) {
+        std::cerr << "Error: multiple input files given; use --batch to process them all\n";
         return 1;
     }
 
-    std::ostringstream ss;
-    ss << file.rdbuf();
-    std::string source = ss.str();
+    std::unique_ptr<bf::CompileCache> cache;
+    if (use_cache) cache = std::make_unique<bf::CompileCache>(cache_dir);
 
-    auto tokens = bf::lex(source);
-    auto program = bf::parse(tokens);
-    program = bf::optimize(program);
+    if (batch) {
+        // 批量模式下 -o 指定输出目录，各文件的错误收集起来最后统一报告
+        std::vector<std::string> files;
+        try {
+            files = bf::expand_inputs(inputs);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << "\n";
+            return 1;
+        }
+        if (files.empty()) {
+            std::cerr << "Error: no input files\n";
+            return 1;
+        }
+        if (!output_file.empty()) {
+            std::error_code ec;
+            std::filesystem::create_directories(output_file, ec);
+        }
+        auto output_of = [&](const std::string& input) {
+            std::string output = default_output(input, emit);
+            if (!output_file.empty()) {
+                output = (std::filesystem::path(output_file) /
+                          std::filesystem::path(output).filename()).string();
+            }
+            return output;
+        };
+        // -o 目录只保留文件名，不同目录下的同名输入会写到同一个输出，先挑出来报错
+        const size_t total = files.size();
+        auto errors = bf::take_output_conflicts(files, output_of);
+        std::atomic<size_t> hits{0};
+        auto failed = bf::run_batch(files, jobs, [&](const std::string& input) {
+            if (transpile_file(input, output_of(input), cell_bits, emit, cache.get())) ++hits;
+        });
+        errors.insert(errors.end(), failed.begin(), failed.end());
+        for (const auto& e : errors) {
+            std::cerr << "Error: " << e.input << ": " << e.message << "\n";
+        }
+        std::cout << "Transpiled " << total - errors.size() << " of " << total << " files";
+        if (!errors.empty()) std::cout << " (" << errors.size() << " failed)";
+        if (cache) std::cout << ", " << hits << " from cache";
+        std::cout << "\n";
+        return errors.empty() ? 0 : 1;
+    }
 
-    std::string c_code = transpile_to_c(program);
+    const std::string& input_file = inputs.front();
+    if (output_file.empty()) output_file = default_output(input_file, emit);
 
-    std::ofstream out(output_file);
-    if (!out) {
-        std::cerr << "Error: cannot write to '" << output_file << "'\n";
+    bool hit = false;
+    try {
+        hit = transpile_file(input_file, output_file, cell_bits, emit, cache.get());
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
         return 1;
     }
-    out << c_code;
-    std::cout << "Transpiled to: " << output_file << "\n";
+    std::cout << "Transpiled to: " << output_file << (hit ? " (cached)" : "") << "\n";
 
     return 0;
 }
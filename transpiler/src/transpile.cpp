@@ -0,0 +1,246 @@
+#include "transpile.h"
+#include "bf/optimizer.h"
+#include <sstream>
+
+namespace bf {
+
+// AddVal/MulAdd 的系数按单元格宽度截断为无符号数，高一半写成减去其补数。
+// 全程用 uint32_t 计算，operand 为 INT32_MIN 时也不对有符号数取负
+static uint32_t addend(int32_t operand, uint32_t mask, bool& subtract) {
+    uint32_t u = static_cast<uint32_t>(operand) & mask;
+    subtract = u > mask / 2;
+    return subtract ? (0u - u) & mask : u;
+}
+
+std::string transpile_to_c(const std::vector<IRInst>& program, int cell_bits) {
+    std::ostringstream out;
+    int indent = 1;
+    const uint32_t mask = cell_mask(cell_bits);
+    const bool wide = cell_bits != 8;
+    const char* cell_type = cell_bits == 16 ? "uint16_t" : cell_bits == 32 ? "uint32_t" : "unsigned char";
+    // 宽单元格的乘法用无符号字面量，避免提升为 int 后溢出
+    const char* lit = wide ? "u" : "";
+
+    out << "#include <stdio.h>\n";
+    if (wide) out << "#include <stdint.h>\n";
+    out << "#include <string.h>\n\n";
+    out << "int main(void) {\n";
+    // tape 前后各预留 TAPE_MARGIN 个单元格，见 bf/optimizer.h
+    out << "    " << cell_type << " tape[" << TAPE_MARGIN << " + " << TAPE_SIZE << " + " << TAPE_MARGIN << "];\n";
+    out << "    memset(tape, 0, sizeof(tape));\n";
+    out << "    " << cell_type << " *ptr = tape + " << TAPE_MARGIN << ";\n\n";
+
+    auto emit_indent = [&]() {
+        for (int i = 0; i < indent; ++i) out << "    ";
+    };
+
+    // 访存指令的单元格表达式：offset 为 0 时用 *ptr，否则用 ptr[k]
+    auto cell = [](int offset) {
+        return offset == 0 ? std::string("*ptr")
+                           : "ptr[" + std::to_string(offset) + "]";
+    };
+
+    for (const auto& inst : program) {
+        switch (inst.type) {
+            case IRType::MovePtr:
+                emit_indent();
+                if (inst.operand > 0)
+                    out << "ptr += " << inst.operand << ";\n";
+                else
+                    out << "ptr -= " << -inst.operand << ";\n";
+                break;
+            case IRType::AddVal: {
+                bool sub = false;
+                uint32_t v = addend(inst.operand, mask, sub);
+                emit_indent();
+                out << cell(inst.offset) << (sub ? " -= " : " += ") << v << lit << ";\n";
+                break;
+            }
+            case IRType::Output:
+                emit_indent();
+                out << "putchar(" << cell(inst.offset) << ");\n";
+                break;
+            case IRType::Input:
+                emit_indent();
+                out << cell(inst.offset) << " = (" << cell_type << ")getchar();\n";
+                break;
+            case IRType::LoopBegin:
+                emit_indent();
+                out << "while (" << cell(inst.offset) << ") {\n";
+                ++indent;
+                break;
+            case IRType::LoopEnd:
+                --indent;
+                emit_indent();
+                out << "}\n";
+                break;
+            case IRType::SetZero:
+                emit_indent();
+                out << cell(inst.offset) << " = 0;\n";
+                break;
+            case IRType::SetVal:
+                emit_indent();
+                out << cell(inst.offset) << " = " << (static_cast<uint32_t>(inst.operand) & mask) << lit << ";\n";
+                break;
+            case IRType::ScanZero:
+                emit_indent();
+                if (inst.operand > 0)
+                    out << "while (*ptr) ptr += " << inst.operand << ";\n";
+                else
+                    out << "while (*ptr) ptr -= " << -inst.operand << ";\n";
+                break;
+            case IRType::MulAdd: {
+                bool sub = false;
+                uint32_t v = addend(inst.operand, mask, sub);
+                emit_indent();
+                out << cell(inst.offset) << (sub ? " -= " : " += ") << cell(inst.src_offset);
+                if (v != 1) out << " * " << v << lit;
+                out << ";\n";
+                break;
+            }
+        }
+    }
+
+    out << "\n    return 0;\n";
+    out << "}\n";
+    return out.str();
+}
+
+std::string transpile_to_c_indexed(const std::vector<IRInst>& program, int cell_bits) {
+    std::ostringstream out;
+    int indent = 1;
+    const uint32_t mask = cell_mask(cell_bits);
+    const bool wide = cell_bits != 8;
+    const char* cell_type = cell_bits == 16 ? "uint16_t" : cell_bits == 32 ? "uint32_t" : "uint8_t";
+    const char* lit = wide ? "u" : "";
+
+    out << "#include <stddef.h>\n";
+    out << "#include <stdint.h>\n";
+    out << "#include <stdio.h>\n";
+    out << "#include <stdlib.h>\n";
+    out << "#include <string.h>\n\n";
+    out << "typedef " << cell_type << " cell;\n\n";
+    // tape 前后各预留 TAPE_MARGIN 个单元格，见 bf/optimizer.h
+    out << "#define TAPE_MARGIN " << TAPE_MARGIN << "\n";
+    out << "#define TAPE_CELLS (TAPE_MARGIN + " << TAPE_SIZE << " + TAPE_MARGIN)\n";
+    out << "#define OUT_SIZE 4096\n\n";
+    out << "static inline size_t put(unsigned char *restrict out, size_t n, cell c) {\n";
+    out << "    out[n++] = (unsigned char)c;\n";
+    out << "    if (n == OUT_SIZE) {\n";
+    out << "        fwrite(out, 1, n, stdout);\n";
+    out << "        n = 0;\n";
+    out << "    }\n";
+    out << "    return n;\n";
+    out << "}\n\n";
+    if (!wide) {
+        // [>] 即找下一个 0 字节；到 tape 末尾都没有 0 时数据指针越界，与解释器一样报错退出
+        out << "static inline size_t scan_right(const cell *restrict tape, size_t p) {\n";
+        out << "    const cell *z = (const cell *)memchr(tape + p, 0, TAPE_CELLS - p);\n";
+        out << "    if (!z) {\n";
+        out << "        fputs(\"Error: data pointer moved outside the tape\\n\", stderr);\n";
+        out << "        exit(1);\n";
+        out << "    }\n";
+        out << "    return (size_t)(z - tape);\n";
+        out << "}\n\n";
+    }
+    out << "static void run(cell *restrict tape, unsigned char *restrict out) {\n";
+    out << "    size_t p = TAPE_MARGIN;\n";
+    out << "    size_t n = 0;\n\n";
+
+    auto emit_indent = [&]() {
+        for (int i = 0; i < indent; ++i) out << "    ";
+    };
+
+    // 相对下标 p 的单元格表达式 tape[p + k]
+    auto cell = [](int offset) {
+        if (offset == 0) return std::string("tape[p]");
+        return "tape[p " + std::string(offset > 0 ? "+ " : "- ") +
+               std::to_string(offset > 0 ? offset : -offset) + "]";
+    };
+
+    for (const auto& inst : program) {
+        switch (inst.type) {
+            case IRType::MovePtr:
+                emit_indent();
+                if (inst.operand > 0)
+                    out << "p += " << inst.operand << ";\n";
+                else
+                    out << "p -= " << -inst.operand << ";\n";
+                break;
+            case IRType::AddVal: {
+                bool sub = false;
+                uint32_t v = addend(inst.operand, mask, sub);
+                emit_indent();
+                out << cell(inst.offset) << (sub ? " -= " : " += ") << v << lit << ";\n";
+                break;
+            }
+            case IRType::Output:
+                emit_indent();
+                out << "n = put(out, n, " << cell(inst.offset) << ");\n";
+                break;
+            case IRType::Input:
+                // 读取前写出已缓冲的输出，交互式程序的提示才会先出现
+                emit_indent();
+                out << "fwrite(out, 1, n, stdout);\n";
+                emit_indent();
+                out << "fflush(stdout);\n";
+                emit_indent();
+                out << "n = 0;\n";
+                emit_indent();
+                out << cell(inst.offset) << " = (cell)getchar();\n";
+                break;
+            case IRType::LoopBegin:
+                emit_indent();
+                out << "while (" << cell(inst.offset) << ") {\n";
+                ++indent;
+                break;
+            case IRType::LoopEnd:
+                --indent;
+                emit_indent();
+                out << "}\n";
+                break;
+            case IRType::SetZero:
+                emit_indent();
+                out << cell(inst.offset) << " = 0;\n";
+                break;
+            case IRType::SetVal:
+                emit_indent();
+                out << cell(inst.offset) << " = " << (static_cast<uint32_t>(inst.operand) & mask) << lit << ";\n";
+                break;
+            case IRType::ScanZero:
+                emit_indent();
+                if (inst.operand == 1 && !wide)
+                    out << "p = scan_right(tape, p);\n";
+                else if (inst.operand > 0)
+                    out << "while (tape[p]) p += " << inst.operand << ";\n";
+                else
+                    out << "while (tape[p]) p -= " << -inst.operand << ";\n";
+                break;
+            case IRType::MulAdd: {
+                bool sub = false;
+                uint32_t v = addend(inst.operand, mask, sub);
+                emit_indent();
+                out << cell(inst.offset) << (sub ? " -= " : " += ") << cell(inst.src_offset);
+                if (v != 1) out << " * " << v << lit;
+                out << ";\n";
+                break;
+            }
+        }
+    }
+
+    out << "\n    fwrite(out, 1, n, stdout);\n";
+    out << "}\n\n";
+    // 缓冲区在堆上分配：静态数组在 PIE 下只能 RIP 相对寻址，不能与下标合成一个操作数
+    out << "int main(void) {\n";
+    out << "    cell *tape = (cell *)calloc(TAPE_CELLS, sizeof(cell));\n";
+    out << "    unsigned char *out = (unsigned char *)malloc(OUT_SIZE);\n";
+    out << "    if (!tape || !out) return 1;\n";
+    out << "    run(tape, out);\n";
+    out << "    free(out);\n";
+    out << "    free(tape);\n";
+    out << "    return 0;\n";
+    out << "}\n";
+    return out.str();
+}
+
+} // namespace bf
@@ -0,0 +1,21 @@
+#pragma once
+#include "bf/ir.h"
+#include <string>
+#include <vector>
+
+namespace bf {
+
+// 把优化后的 IR 翻译为一个完整的 C 源文件。
+// cell_bits 为单元格位数 (8/16/32)，与 optimize_in_place 使用的一致。
+std::string transpile_to_c(const std::vector<IRInst>& program, int cell_bits = 8);
+
+// 同上，但生成便于 C 编译器优化的形式：数据指针是局部下标 p，单元格访问写成 tape[p + k]，
+// tape 和输出缓冲区以 restrict 指针传入，扫描循环用 memchr，输出先写入缓冲区再 fwrite。
+// 没有指针追逐和字符类型的别名，循环体内的访存都是同一基址加常量偏移，便于别名分析和向量化。
+std::string transpile_to_c_indexed(const std::vector<IRInst>& program, int cell_bits = 8);
+
+// 把优化后的 IR 翻译为 LLVM IR 文本 (.ll)，交给 opt/llc 或 clang 生成本地代码。
+// 单元格是精确宽度的 iN，tape 是 internal 全局数组，每个循环对应显式的入口、循环体和出口基本块
+std::string transpile_to_llvm(const std::vector<IRInst>& program, int cell_bits = 8);
+
+} // namespace bf
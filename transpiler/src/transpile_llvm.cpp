@@ -0,0 +1,185 @@
+#include "transpile.h"
+#include "bf/optimizer.h"
+#include <sstream>
+#include <vector>
+
+namespace bf {
+
+// 生成 LLVM IR 文本。数据指针 p 是 SSA 值（i64 下标），循环入口用 phi 合并进入前和回边的 p；
+// tape 是只在本模块内使用的 internal 全局数组，地址不逃逸，LLVM 可以确定它不与其他内存别名。
+// 指针写成 iN* 形式，LLVM 14 默认即可解析，之后的版本也会把它当作 ptr 读入
+std::string transpile_to_llvm(const std::vector<IRInst>& program, int cell_bits) {
+    std::ostringstream out;
+    const std::string ty = "i" + std::to_string(cell_bits);
+    const std::string tape_ty =
+        "[" + std::to_string(TAPE_MARGIN + TAPE_SIZE + TAPE_MARGIN) + " x " + ty + "]";
+    const uint32_t mask = cell_mask(cell_bits);
+
+    // 按单元格位数截断后以有符号数打印，字面量总在 iN 的取值范围内
+    auto imm = [&](int v) {
+        uint32_t u = static_cast<uint32_t>(v) & mask;
+        int64_t s = u;
+        if (cell_bits < 32 && (u >> (cell_bits - 1)) & 1) s -= int64_t(1) << cell_bits;
+        else if (cell_bits == 32) s = static_cast<int32_t>(u);
+        return std::to_string(s);
+    };
+
+    out << "; ModuleID = 'bf'\n\n";
+    out << "@tape = internal global " << tape_ty << " zeroinitializer, align 16\n\n";
+    out << "declare i32 @putchar(i32) nounwind\n";
+    out << "declare i32 @getchar() nounwind\n\n";
+    out << "define i32 @main() nounwind {\n";
+    out << "entry:\n";
+
+    int tmp = 0;
+    int label = 0;
+    auto fresh = [&]() { return "%t" + std::to_string(tmp++); };
+    std::string p = std::to_string(TAPE_MARGIN); // 当前 p，常量或 SSA 值
+    std::string block = "entry";                 // 当前基本块，phi 的来源
+
+    // base + delta，base 为常量（还没经过循环或扫描）时直接折叠
+    auto add_index = [&](const std::string& base, int delta) {
+        if (delta == 0) return base;
+        if (base[0] != '%') return std::to_string(std::stoll(base) + delta);
+        std::string r = fresh();
+        out << "  " << r << " = add i64 " << base << ", " << delta << "\n";
+        return r;
+    };
+
+    // 单元格 tape[p + offset] 的地址
+    auto addr = [&](const std::string& base, int offset) {
+        std::string idx = add_index(base, offset);
+        std::string a = fresh();
+        out << "  " << a << " = getelementptr inbounds " << tape_ty << ", " << tape_ty
+            << "* @tape, i64 0, i64 " << idx << "\n";
+        return a;
+    };
+    auto load = [&](const std::string& a) {
+        std::string v = fresh();
+        out << "  " << v << " = load " << ty << ", " << ty << "* " << a << ", align 1\n";
+        return v;
+    };
+    auto store = [&](const std::string& v, const std::string& a) {
+        out << "  store " << ty << " " << v << ", " << ty << "* " << a << ", align 1\n";
+    };
+
+    // 尚未闭合的循环编号
+    std::vector<int> loops;
+
+    for (const auto& inst : program) {
+        switch (inst.type) {
+            case IRType::MovePtr:
+                p = add_index(p, inst.operand);
+                break;
+            case IRType::AddVal: {
+                std::string a = addr(p, inst.offset);
+                std::string v = load(a);
+                std::string r = fresh();
+                out << "  " << r << " = add " << ty << " " << v << ", " << imm(inst.operand) << "\n";
+                store(r, a);
+                break;
+            }
+            case IRType::Output: {
+                std::string v = load(addr(p, inst.offset));
+                std::string c = v;
+                if (cell_bits < 32) {
+                    c = fresh();
+                    out << "  " << c << " = zext " << ty << " " << v << " to i32\n";
+                }
+                out << "  call i32 @putchar(i32 " << c << ")\n";
+                break;
+            }
+            case IRType::Input: {
+                std::string a = addr(p, inst.offset);
+                std::string c = fresh();
+                out << "  " << c << " = call i32 @getchar()\n";
+                std::string v = c;
+                if (cell_bits < 32) {
+                    v = fresh();
+                    out << "  " << v << " = trunc i32 " << c << " to " << ty << "\n";
+                }
+                store(v, a);
+                break;
+            }
+            case IRType::LoopBegin: {
+                // 入口块的 phi 引用回边块 Ln.latch 中的 %pn.latch，它们在循环结束时才生成
+                int n = label++;
+                std::string head = "L" + std::to_string(n);
+                out << "  br label %" << head << ".head\n\n";
+                out << head << ".head:\n";
+                std::string ph = "%p" + std::to_string(n);
+                out << "  " << ph << " = phi i64 [ " << p << ", %" << block << " ], [ " << ph
+                    << ".latch, %" << head << ".latch ]\n";
+                std::string v = load(addr(ph, inst.offset));
+                std::string c = fresh();
+                out << "  " << c << " = icmp ne " << ty << " " << v << ", 0\n";
+                out << "  br i1 " << c << ", label %" << head << ".body, label %" << head << ".exit\n\n";
+                out << head << ".body:\n";
+                loops.push_back(n);
+                p = ph;
+                block = head + ".body";
+                break;
+            }
+            case IRType::LoopEnd: {
+                int n = loops.back();
+                loops.pop_back();
+                std::string head = "L" + std::to_string(n);
+                std::string ph = "%p" + std::to_string(n);
+                out << "  br label %" << head << ".latch\n\n";
+                out << head << ".latch:\n";
+                out << "  " << ph << ".latch = phi i64 [ " << p << ", %" << block << " ]\n";
+                out << "  br label %" << head << ".head\n\n";
+                out << head << ".exit:\n";
+                // 出口只从入口块跳来，p 就是入口的 phi
+                p = ph;
+                block = head + ".exit";
+                break;
+            }
+            case IRType::SetZero:
+                store("0", addr(p, inst.offset));
+                break;
+            case IRType::SetVal:
+                store(imm(inst.operand), addr(p, inst.offset));
+                break;
+            case IRType::ScanZero: {
+                // 自环块：当前单元格非 0 就移动 p 再测
+                int n = label++;
+                std::string scan = "S" + std::to_string(n);
+                std::string ps = "%s" + std::to_string(n);
+                out << "  br label %" << scan << "\n\n";
+                out << scan << ":\n";
+                out << "  " << ps << " = phi i64 [ " << p << ", %" << block << " ], [ " << ps
+                    << ".next, %" << scan << " ]\n";
+                std::string v = load(addr(ps, 0));
+                out << "  " << ps << ".next = add i64 " << ps << ", " << inst.operand << "\n";
+                std::string c = fresh();
+                out << "  " << c << " = icmp ne " << ty << " " << v << ", 0\n";
+                out << "  br i1 " << c << ", label %" << scan << ", label %" << scan << ".exit\n\n";
+                out << scan << ".exit:\n";
+                p = ps;
+                block = scan + ".exit";
+                break;
+            }
+            case IRType::MulAdd: {
+                std::string s = load(addr(p, inst.src_offset));
+                std::string a = addr(p, inst.offset);
+                std::string v = load(a);
+                std::string m = s;
+                if (inst.operand != 1) {
+                    m = fresh();
+                    out << "  " << m << " = mul " << ty << " " << s << ", " << imm(inst.operand) << "\n";
+                }
+                std::string r = fresh();
+                out << "  " << r << " = add " << ty << " " << v << ", " << m << "\n";
+                store(r, a);
+                break;
+            }
+        }
+    }
+
+    out << "  ret i32 0\n";
+    out << "}\n";
+    return out.str();
+}
+
+} // namespace bf